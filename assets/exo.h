@@ -1,27 +1,235 @@
-#include <stddef.h>
+/*
+    The exo, its inner shell and the menger cube, made at
+    startup instead of baked into the binary.
 
-#include "../inc/gl.h"
+    exoInit() subdivides an icosahedron to the level asked
+    for with isMake() from icosphere.h and puts the shades
+    on by midpoint displacement down the subdivision; each
+    new vertex is the mean of the two it was made between
+    plus a counter based random offset that halves every
+    level, so the shading is a fractal of the same shape
+    whatever the level. Then isOrder() sorts the vertices
+    into the order the triangles use them. Only integer
+    hashing, adds, multiplies and sqrtf() go into it so
+    every client makes the same planet. The exo is shared
+    simulation state, the damage to end a game is half
+    its vertices and its craters are in the state hash,
+    so the game and fa-sim always make EXO_LEVEL; other
+    levels are for tools.
+
+    The menger cube is NCUBE_LEVEL deep with the faces
+    between two filled cells left out.
+
+    Requires:
+        - gl.h
+        - icosphere.h
+        - crand.h
+*/
 
 #ifndef exo_H
 #define exo_H
 
-extern GLfloat exo_vertices[];
-extern GLfloat exo_colors[];
-extern const GLuint exo_indices[];
-extern const GLsizeiptr exo_numind;
-extern const GLsizeiptr exo_numvert;
-extern const size_t exo_vertices_size;
-extern const size_t exo_colors_size;
-extern const size_t exo_indices_size;
-
-extern GLfloat ncube_vertices[];
-extern const GLuint ncube_indices[];
-extern const GLsizeiptr ncube_numind;
-extern const GLsizeiptr ncube_numvert;
-extern const size_t ncube_vertices_size;
-extern const size_t ncube_indices_size;
-
-extern GLfloat inner_colors[];
-extern const size_t inner_colors_size;
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "../inc/gl.h"
+#include "../inc/icosphere.h"
+#include "../inc/crand.h"
+
+#define EXO_LEVEL 6         // default, 40962 vertices
+#define EXO_MIN_LEVEL 3
+#define EXO_MAX_LEVEL 8
+#define EXO_RADIUS 110.5f  // 1.131 to 1.138 after GFX_SCALE and simExo(), under the 1.14 comets burst at and over the 1.13 players stop at
+#define EXO_SEED 0x45584f   // the shading, not the epoch, it is the same planet every game
+#define NCUBE_LEVEL 2
+#define NCUBE_SIZE 10.f
+
+unsigned int exo_level;
+GLfloat* exo_vertices;
+GLfloat* exo_colors;
+GLuint* exo_indices;
+GLsizeiptr exo_numind;
+GLsizeiptr exo_numvert;
+size_t exo_vertices_size;
+size_t exo_colors_size;
+size_t exo_indices_size;
+
+GLfloat* ncube_vertices;
+GLuint* ncube_indices;
+GLsizeiptr ncube_numind;
+GLsizeiptr ncube_numvert;
+size_t ncube_vertices_size;
+size_t ncube_indices_size;
+
+GLfloat* inner_colors;
+size_t inner_colors_size;
+
+int  exoInit(const unsigned int level);
+void exoFree();
+
+//
+
+// 1 if the cell is in the sponge, no two of its base 3 digits at the same place are 1
+static inline int exoSponge(unsigned int x, unsigned int y, unsigned int z)
+{
+    for(unsigned int i = 0; i < NCUBE_LEVEL; i++)
+    {
+        if((x%3 == 1) + (y%3 == 1) + (z%3 == 1) >= 2){return 0;}
+        x /= 3; y /= 3; z /= 3;
+    }
+    return 1;
+}
+
+int exoMenger()
+{
+    unsigned int n = 1;
+    for(unsigned int i = 0; i < NCUBE_LEVEL; i++){n *= 3;}
+
+    // count the open faces first
+    unsigned int faces = 0;
+    for(unsigned int z = 0; z < n; z++)
+    for(unsigned int y = 0; y < n; y++)
+    for(unsigned int x = 0; x < n; x++)
+    {
+        if(exoSponge(x, y, z) == 0){continue;}
+        const unsigned int c[3] = {x, y, z};
+        for(unsigned int f = 0; f < 6; f++)
+        {
+            unsigned int d[3] = {x, y, z};
+            const unsigned int a = f >> 1;
+            if(f & 1){if(c[a] == 0){faces++; continue;} d[a]--;}
+            else     {if(c[a] == n-1){faces++; continue;} d[a]++;}
+            if(exoSponge(d[0], d[1], d[2]) == 0){faces++;}
+        }
+    }
+
+    ncube_numvert = faces * 4;
+    ncube_numind = faces * 6;
+    ncube_vertices_size = ncube_numvert * 3 * sizeof(GLfloat);
+    ncube_indices_size = ncube_numind * sizeof(GLuint);
+    ncube_vertices = malloc(ncube_vertices_size);
+    ncube_indices = malloc(ncube_indices_size);
+    if(ncube_vertices == NULL || ncube_indices == NULL){return -1;}
+
+    // a quad a face, counter clockwise from outside
+    static const float q[4][2] = {{0.f, 0.f}, {1.f, 0.f}, {1.f, 1.f}, {0.f, 1.f}};
+    const float s = NCUBE_SIZE / (float)n;
+    const float o = NCUBE_SIZE * 0.5f;
+    GLfloat* v = ncube_vertices;
+    GLuint* ind = ncube_indices;
+    GLuint vi = 0;
+    for(unsigned int z = 0; z < n; z++)
+    for(unsigned int y = 0; y < n; y++)
+    for(unsigned int x = 0; x < n; x++)
+    {
+        if(exoSponge(x, y, z) == 0){continue;}
+        const unsigned int c[3] = {x, y, z};
+        for(unsigned int f = 0; f < 6; f++)
+        {
+            unsigned int d[3] = {x, y, z};
+            const unsigned int a = f >> 1;
+            if(f & 1){if(c[a] > 0){d[a]--; if(exoSponge(d[0], d[1], d[2]) == 1){continue;}}}
+            else     {if(c[a] < n-1){d[a]++; if(exoSponge(d[0], d[1], d[2]) == 1){continue;}}}
+
+            // u and w follow a round, so u x w is +a; the back faces go the other way
+            const unsigned int u = (a+1)%3, w = (a+2)%3;
+            for(unsigned int k = 0; k < 4; k++)
+            {
+                const unsigned int j = (f & 1) ? 3-k : k;
+                float p[3];
+                p[a] = (float)(c[a] + ((f & 1) ? 0 : 1));
+                p[u] = (float)c[u] + q[j][0];
+                p[w] = (float)c[w] + q[j][1];
+                *v++ = p[0]*s - o;
+                *v++ = p[1]*s - o;
+                *v++ = p[2]*s - o;
+            }
+            *ind++ = vi;   *ind++ = vi+1; *ind++ = vi+2;
+            *ind++ = vi;   *ind++ = vi+2; *ind++ = vi+3;
+            vi += 4;
+        }
+    }
+    return 0;
+}
+
+// returns 0 on success, -1 out of memory or a level out of range
+int exoInit(const unsigned int level)
+{
+    if(level < EXO_MIN_LEVEL || level > EXO_MAX_LEVEL){return -1;}
+    icomesh m;
+    if(isMake(&m, level, EXO_RADIUS) < 0){return -1;}
+    exo_level = level;
+
+    exo_numvert = m.nv;
+    exo_numind = m.ni;
+    exo_vertices_size = exo_numvert * 3 * sizeof(GLfloat);
+    exo_colors_size = exo_vertices_size;
+    exo_indices_size = exo_numind * sizeof(GLuint);
+    inner_colors_size = exo_colors_size;
+    float* g = malloc(exo_numvert * sizeof(float));
+    unsigned int* from = malloc(exo_numvert * sizeof(unsigned int));
+    exo_colors = malloc(exo_colors_size);
+    inner_colors = malloc(inner_colors_size);
+    if(g == NULL || from == NULL || exo_colors == NULL || inner_colors == NULL)
+    {
+        free(g);
+        free(from);
+        isFree(&m);
+        return -1;
+    }
+
+    // midpoint displacement of a grey level, in the subdivision order the parents always come
+    // first and a vertex has the same number at every level, so has the same shade
+    const crkey k = crKey(EXO_SEED, 0, 0);
+    float amp = 0.3f;
+    unsigned int l = 0;
+    for(unsigned int i = 0; i < m.nv; i++)
+    {
+        if(i == isVerts(l)){l++; amp *= 0.5f;}
+        const float r = crFC(crU32(k, i));
+        float s;
+        if(i < 12)
+            s = 0.65f + r*amp;
+        else
+            s = (g[m.par[i*2]] + g[m.par[i*2+1]])*0.5f + r*amp;
+        if(s < 0.2f){s = 0.2f;}
+        else if(s > 1.f){s = 1.f;}
+        g[i] = s;
+    }
+
+    if(isOrder(&m, from) < 0)
+    {
+        free(g);
+        free(from);
+        isFree(&m);
+        return -1;
+    }
+    for(unsigned int i = 0; i < m.nv; i++)
+    {
+        const float s = g[from[i]];
+        exo_colors[i*3] = exo_colors[i*3+1] = exo_colors[i*3+2] = s;
+        inner_colors[i*3] = inner_colors[i*3+1] = inner_colors[i*3+2] = s*0.4f;
+    }
+    free(g);
+    free(from);
+
+    // the mesh keeps its arrays, they are the exo from here on
+    exo_vertices = m.v;
+    exo_indices = m.ind;
+    free(m.par);
+    return exoMenger();
+}
+
+void exoFree()
+{
+    free(exo_vertices);
+    free(exo_colors);
+    free(exo_indices);
+    free(inner_colors);
+    free(ncube_vertices);
+    free(ncube_indices);
+    exo_vertices = exo_colors = inner_colors = ncube_vertices = NULL;
+    exo_indices = ncube_indices = NULL;
+}
 
 #endif
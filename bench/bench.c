@@ -0,0 +1,274 @@
+/*
+    Hot path microbenchmarks with JSON results.
+
+    Times each function on its own, headless, against the
+    real exo mesh and the shared simulation in inc/sim.h;
+    a few warmup repetitions then BENCH_REPS timed ones of
+    a fixed batch of calls each. Every case reports the
+    min, median, mean and max nanoseconds per call over
+    the repetitions and the JSON goes to a file so two
+    runs, say before and after a change, can be compared
+    with any JSON diff tool.
+
+    make bench && ./bench/bench [json file, default bench.json]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#define SEIR_RAND
+
+#include "../inc/sim.h"
+#include "../inc/mat.h"
+
+#define BENCH_WARMUP 3
+#define BENCH_REPS 21
+#define SEED 1668000000
+
+// keeps the compiler from dropping a result nobody reads
+#define keep(x) __asm__ volatile("" : : "g"(&(x)) : "memory")
+
+typedef struct
+{
+    const char* name;
+    unsigned int n;         // calls per repetition
+    void (*setup)();        // before every repetition, not timed
+    void (*run)(const unsigned int n);
+} benchcase;
+
+uint64_t nanotime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+int cmpd(const void* a, const void* b)
+{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+//*************************************
+// cases
+//*************************************
+
+siminput idle;
+float no_players[MAX_PLAYERS*3] = {0};
+vec impact_p[256];
+float impact_f[256];
+float net_buffer[MAX_PLAYERS*3];
+float net_players[MAX_PLAYERS*3];
+mat ma, mb, mr;
+vec va, vb;
+
+// a fresh crater mesh and comet field at the epoch
+void resetSim()
+{
+    const size_t bytes = exo_numvert * 3 * sizeof(float);
+    memcpy(exo_vertices, exo_base, bytes);
+    memcpy(exo_colors, exo_base_colors, bytes);
+    egReset(&exo_grid, exo_numvert);
+    egSync(&exo_grid, exo_vertices, exo_base, exo_numvert);
+    damage = hits = popped = 0;
+    sim_seed = SEED;
+    memset(comet_spawns, 0, sizeof(comet_spawns));
+    randComets();
+}
+
+void runExoImpact(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        doExoImpact(impact_p[i & 255], impact_f[i & 255]);
+}
+
+void runCometKernels(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        csIntegrate(&comets, SIM_DT);
+        csPlanet(&comets, 1.14f);
+        csPlayers(&comets, player_pos, 1, 0.06f);
+    }
+}
+
+void runSimTick(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        simTick(&idle);
+}
+
+void runRandComet(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        randComet(i & (NUM_COMETS-1));
+}
+
+void runMul(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        mMul(&mr, &ma, &mb);
+        keep(mr);
+    }
+}
+
+void runTranslate(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        mTranslate(&mr, va.x, va.y, (float)i);
+        keep(mr);
+    }
+}
+
+void runRotX(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        mRotX(&mr, (float)(i & 1023) * 0.001f);
+        keep(mr);
+    }
+}
+
+void runNorm(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        vec v = va;
+        v.z += (float)(i & 1023);
+        vNorm(&v);
+        keep(v);
+    }
+}
+
+void runDist(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        vec v = va;
+        v.z += (float)(i & 1023);
+        float d = vDist(v, vb);
+        keep(d);
+    }
+}
+
+void runPlayersIn(const unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        simPlayersIn(net_players, net_buffer, sizeof(net_buffer));
+        keep(net_players);
+    }
+}
+
+benchcase cases[] = {
+    {"doExoImpact",     256,   resetSim, runExoImpact},
+    {"cometKernels",    4096,  resetSim, runCometKernels},
+    {"simTick",         1200,  resetSim, runSimTick},
+    {"randComet",       4096,  NULL,     runRandComet},
+    {"mMul",            65536, NULL,     runMul},
+    {"mTranslate",      65536, NULL,     runTranslate},
+    {"mRotX",           65536, NULL,     runRotX},
+    {"vNorm",           65536, NULL,     runNorm},
+    {"vDist",           65536, NULL,     runDist},
+    {"cbPlayerCopy",    65536, NULL,     runPlayersIn},
+};
+
+//*************************************
+// harness
+//*************************************
+
+int main(int argc, char** argv)
+{
+    const char* file = argc >= 2 ? argv[1] : "bench.json";
+
+    // same mesh preparation as main()
+    if(exoInit(EXO_LEVEL) < 0)
+    {
+        printf("exoInit() failed.\n");
+        return EXIT_FAILURE;
+    }
+    for(size_t i = 0; i < (size_t)exo_numvert*3; i++)
+        exo_vertices[i] *= GFX_SCALE;
+    simExo();
+    if(simInit(SEED) < 0)
+    {
+        printf("simInit() failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    // fixed inputs, impacts the size and place real ones have
+    memset(&idle, 0, sizeof(siminput));
+    idle.players = no_players;
+    srandf(74235);
+    for(unsigned int i = 0; i < 256; i++)
+    {
+        vRuvBT(&impact_p[i]);
+        vMulS(&impact_p[i], impact_p[i], 1.13f);
+        impact_f[i] = ((0.01f+(randf()*0.07f)) + ((0.16f+(randf()*0.08f))*0.1f))*1.2f;
+    }
+    for(unsigned int i = 0; i < MAX_PLAYERS*3; i++)
+        net_buffer[i] = randfc();
+    mIdent(&ma);
+    mRotY(&ma, 0.3f);
+    mTranslate(&mb, 0.1f, 0.2f, 0.3f);
+    va = (vec){0.3f, -1.2f, 2.f};
+    vb = (vec){-0.5f, 0.7f, 0.1f};
+
+    FILE* f = fopen(file, "w");
+    if(f == NULL)
+    {
+        printf("could not write %s\n", file);
+        return EXIT_FAILURE;
+    }
+#if defined(__AVX2__) && !defined(NOSSE)
+    const char* simd = "avx2";
+#elif !defined(NOSSE)
+    const char* simd = "sse";
+#else
+    const char* simd = "none";
+#endif
+#ifdef DETERMINISTIC
+    const int det = 1;
+#else
+    const int det = 0;
+#endif
+    fprintf(f, "{\n  \"timestamp\": %lu,\n  \"simd\": \"%s\",\n  \"deterministic\": %s,\n  \"exo_numvert\": %u,\n  \"reps\": %u,\n  \"results\": [\n",
+        (unsigned long)time(0), simd, det ? "true" : "false", (unsigned int)exo_numvert, BENCH_REPS);
+
+    const unsigned int nc = sizeof(cases) / sizeof(benchcase);
+    for(unsigned int c = 0; c < nc; c++)
+    {
+        const benchcase* b = &cases[c];
+        double ns[BENCH_REPS];
+        for(int r = -BENCH_WARMUP; r < BENCH_REPS; r++)
+        {
+            if(b->setup != NULL){b->setup();}
+            const uint64_t st = nanotime();
+            b->run(b->n);
+            const uint64_t el = nanotime() - st;
+            if(r >= 0){ns[r] = (double)el / b->n;}
+        }
+        qsort(ns, BENCH_REPS, sizeof(double), cmpd);
+        double mean = 0.0;
+        for(unsigned int r = 0; r < BENCH_REPS; r++)
+            mean += ns[r];
+        mean /= BENCH_REPS;
+
+        printf("%-14s %10.2f ns/call median, %10.2f min, %10.2f max\n", b->name, ns[BENCH_REPS/2], ns[0], ns[BENCH_REPS-1]);
+        fprintf(f, "    {\"name\": \"%s\", \"calls\": %u, \"ns_min\": %.3f, \"ns_median\": %.3f, \"ns_mean\": %.3f, \"ns_max\": %.3f}%s\n",
+            b->name, b->n, ns[0], ns[BENCH_REPS/2], mean, ns[BENCH_REPS-1], c+1 < nc ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    printf("results written to %s\n", file);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+/*
+    Comet vs comet broad phase benchmark.
+
+    Runs the comet update without the exo and players,
+    once as the original main_loop() did it, each comet
+    moving on its turn and tested against all the others,
+    and once as simTick() in sim.h does it, every comet
+    moved first and tested through the cgrid, for comet
+    counts from 64 to 16k. Both runs start from the same
+    seed and must end in the same state with the same
+    number of colliding pairs.
+
+    make bench_broadphase && ./bench/broadphase [ticks]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#define SEIR_RAND
+
+#include "../inc/vec.h"
+#include "../inc/cgrid.h"
+
+typedef struct
+{
+    vec dir, pos;
+    float rot, scale, speed;
+} comet;
+
+comet* comets;
+vec* prev;
+unsigned int* near;
+cgrid grid;
+int use_grid = 0;
+
+uint64_t nanotime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+// same as randComet() in main.c
+void randComet(unsigned int i)
+{
+    vRuvBT(&comets[i].pos);
+    vMulS(&comets[i].pos, comets[i].pos, 10.f);
+
+    vec dp;
+    vRuvTA(&dp);
+    vSub(&comets[i].dir, comets[i].pos, dp);
+    vNorm(&comets[i].dir);
+    vInv(&comets[i].dir);
+
+    vec of = comets[i].dir;
+    vInv(&of);
+    vMulS(&of, of, randf()*6.f);
+    vAdd(&comets[i].pos, comets[i].pos, of);
+
+    comets[i].rot = randf()*300.f;
+    comets[i].scale = 0.01f+(randf()*0.07f);
+    comets[i].speed = 0.16f+(randf()*0.08f);
+    if(use_grid == 1){cgMove(&grid, i, comets[i].pos);}
+}
+
+// the original main_loop() comet loop
+unsigned int tick(const unsigned int n, const float dt)
+{
+    unsigned int pairs = 0;
+    for(unsigned int i = 0; i < n; i++)
+    {
+        if(comets[i].speed == 0.f)
+        {
+            comets[i].dir.x -= 0.3f*dt;
+            comets[i].scale -= 0.03f*dt;
+            if(comets[i].dir.x <= 0.f || comets[i].scale <= 0.f)
+                randComet(i);
+            continue;
+        }
+
+        const float pi = comets[i].speed*dt;
+        vAdd(&comets[i].pos, comets[i].pos, (vec){comets[i].dir.x*pi,  comets[i].dir.y*pi, comets[i].dir.z*pi});
+
+        if(vMod(comets[i].pos) < 1.14f)
+        {
+            comets[i].speed = 0.f;
+            comets[i].dir.x = 1.f;
+            comets[i].scale *= 2.f;
+            continue;
+        }
+
+        for(unsigned int k = 0; k < n; k++)
+        {
+            if(k == i){continue;}
+            const float cd = vDistSq(comets[i].pos, comets[k].pos);
+            if(cd < comets[i].scale*comets[i].scale)
+            {
+                comets[i].speed = 0.f;
+                comets[i].dir.x = 1.f;
+                comets[k].speed = 0.f;
+                comets[k].dir.x = 1.f;
+                pairs++;
+            }
+        }
+    }
+    return pairs;
+}
+
+// the same update in the order of simComets() in sim.h
+unsigned int tickGrid(const unsigned int n, const float dt)
+{
+    for(unsigned int i = 0; i < n; i++)
+    {
+        prev[i] = comets[i].pos;
+        if(comets[i].speed <= 0.f){continue;}
+        const float pi = comets[i].speed*dt;
+        vAdd(&comets[i].pos, comets[i].pos, (vec){comets[i].dir.x*pi,  comets[i].dir.y*pi, comets[i].dir.z*pi});
+        cgMove(&grid, i, comets[i].pos);
+    }
+
+    unsigned int pairs = 0;
+    for(unsigned int i = 0; i < n; i++)
+    {
+        if(comets[i].speed == 0.f)
+        {
+            comets[i].dir.x -= 0.3f*dt;
+            comets[i].scale -= 0.03f*dt;
+            if(comets[i].dir.x <= 0.f || comets[i].scale <= 0.f)
+                randComet(i);
+            continue;
+        }
+
+        if(vMod(comets[i].pos) < 1.14f)
+        {
+            comets[i].speed = 0.f;
+            comets[i].dir.x = 1.f;
+            comets[i].scale *= 2.f;
+            continue;
+        }
+
+        const unsigned int nn = cgQuery(&grid, comets[i].pos, comets[i].scale + 0.24f*dt, near);
+        for(unsigned int m = 0; m < nn; m++)
+        {
+            const unsigned int k = near[m];
+            if(k == i){continue;}
+            const vec kp = k > i ? prev[k] : comets[k].pos;
+            const float cd = vDistSq(comets[i].pos, kp);
+            if(cd < comets[i].scale*comets[i].scale)
+            {
+                comets[i].speed = 0.f;
+                comets[i].dir.x = 1.f;
+                comets[k].speed = 0.f;
+                comets[k].dir.x = 1.f;
+                if(k > i)
+                {
+                    comets[k].pos = kp;
+                    cgMove(&grid, k, kp);
+                }
+                pairs++;
+            }
+        }
+    }
+    return pairs;
+}
+
+double run(const unsigned int n, const unsigned int ticks, unsigned int* pairs)
+{
+    srandf(74235);
+    for(unsigned int i = 0; i < n; i++)
+        randComet(i);
+
+    *pairs = 0;
+    const uint64_t st = nanotime();
+    for(unsigned int t = 0; t < ticks; t++)
+        *pairs += use_grid == 1 ? tickGrid(n, 1.f/60.f) : tick(n, 1.f/60.f);
+    return (double)(nanotime() - st) / (double)ticks;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int ticks = 20;
+    if(argc >= 2){ticks = atoi(argv[1]);}
+
+    int r = 0;
+    for(unsigned int n = 64; n <= 16384; n *= 2)
+    {
+        comets = malloc(n * sizeof(comet));
+        comet* ref = malloc(n * sizeof(comet));
+        prev = malloc(n * sizeof(vec));
+        near = malloc(n * sizeof(unsigned int));
+        if(comets == NULL || ref == NULL || prev == NULL || near == NULL || cgInit(&grid, n, 0.16f) < 0)
+        {
+            printf("out of memory\n");
+            return EXIT_FAILURE;
+        }
+
+        unsigned int p0, p1;
+        use_grid = 0;
+        const double brute = run(n, ticks, &p0);
+        memcpy(ref, comets, n * sizeof(comet));
+        use_grid = 1;
+        const double fast = run(n, ticks, &p1);
+
+        const int same = p0 == p1 && memcmp(ref, comets, n * sizeof(comet)) == 0;
+        if(same == 0){r = -1;}
+        printf("%6u comets | all pairs %11.2f us/tick | cgrid %8.2f us/tick | x%-7.1f | pairs %u/%u %s\n",
+            n, brute*1e-3, fast*1e-3, brute/fast, p0, p1, same ? "match" : "MISMATCH");
+
+        cgFree(&grid);
+        free(comets);
+        free(ref);
+        free(prev);
+        free(near);
+    }
+    return r == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+/*
+    Cross build simulation checksum.
+
+    Runs simTick() from sim.h headless over the EXO_LEVEL
+    exo, the same simulation the game and fa-sim run, with
+    the local player idle at its spawn point and no online
+    players, then prints a hash of the final comet, exo and
+    player state alongside simHash().
+
+    Every client has to print the same hash for the same
+    seed, `make checksum` builds this with the deterministic
+    flags for native SSE/AVX, generic x86-64 and plain C and
+    fails if any of them disagree. With the default seed and
+    ticks it also says whether the hash is CS_REFERENCE,
+    the one every x86-64 build prints. No arm64 build (the
+    snap) has been checked against it yet.
+
+    make checksum && ./bench/checksum [seed] [ticks]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if !defined(__x86_64__) && !defined(NOSSE)
+    #define NOSSE
+#endif
+
+#define SEIR_RAND
+
+#include "../inc/sim.h"
+
+#define CS_SEED 1668000000
+#define CS_TICKS (SIM_HZ*60*5)
+#define CS_REFERENCE 0x60cc34a654340dccULL
+
+// fnv-1a
+uint64_t hash(uint64_t h, const void* data, const size_t len)
+{
+    const unsigned char* b = data;
+    for(size_t i = 0; i < len; i++)
+    {
+        h ^= b[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+int main(int argc, char** argv)
+{
+    int seed = CS_SEED;
+    unsigned int ticks = CS_TICKS;
+    if(argc >= 2){seed = atoi(argv[1]);}
+    if(argc >= 3){ticks = atoi(argv[2]);}
+
+    // same mesh preparation as the game
+    if(exoInit(EXO_LEVEL) < 0)
+    {
+        printf("exoInit() failed\n");
+        return EXIT_FAILURE;
+    }
+    for(size_t i = 0; i < (size_t)exo_numvert*3; i++)
+        exo_vertices[i] *= GFX_SCALE;
+    simExo();
+    if(simInit(seed) < 0)
+    {
+        printf("out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    static float no_players[MAX_PLAYERS*3] = {0};
+    siminput idle;
+    memset(&idle, 0, sizeof(siminput));
+    idle.players = no_players;
+    for(unsigned int t = 0; t < ticks; t++)
+        simTick(&idle);
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const size_t cb = NUM_COMETS*sizeof(float);
+    h = hash(h, comets.px, cb); h = hash(h, comets.py, cb); h = hash(h, comets.pz, cb);
+    h = hash(h, comets.dx, cb); h = hash(h, comets.dy, cb); h = hash(h, comets.dz, cb);
+    h = hash(h, comets.scale, cb); h = hash(h, comets.speed, cb);
+    h = hash(h, exo_vertices, exo_numvert*3*sizeof(float));
+    h = hash(h, exo_colors, exo_numvert*3*sizeof(float));
+    h = hash(h, &ppr, sizeof(vec));
+    h = hash(h, &damage, sizeof(damage));
+    h = hash(h, &hits, sizeof(hits));
+    h = hash(h, &popped, sizeof(popped));
+    printf("%016llx sim %016llx damage %u\n", (unsigned long long)h, (unsigned long long)simHash(), damage);
+    if(seed == CS_SEED && ticks == CS_TICKS)
+        fprintf(stderr, "%s the x86-64 reference %016llx\n", h == CS_REFERENCE ? "matches" : "DIFFERS from", (unsigned long long)CS_REFERENCE);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+/*
+    doExoImpact() before/after microbenchmark.
+
+    The baked exo mesh is not needed, a fibonacci sphere
+    with the same vertex count stands in for it. Every
+    impact is applied to two copies of the mesh, one with
+    the original linear scan and one through the exogrid,
+    and both copies have to match bit for bit.
+
+    make bench_exo && ./bench/exo_impact [numvert] [impacts]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#define SEIR_RAND
+
+#include "../inc/vec.h"
+#include "../inc/exogrid.h"
+
+uint64_t nanotime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+// the original doExoImpact() loop
+unsigned int linearImpact(float* v, float* c, const size_t numvert, const vec p, const float f)
+{
+    unsigned int damage = 0;
+    const size_t s = numvert*3;
+    for(size_t i = 0; i < s; i+=3)
+    {
+        vec n = {v[i], v[i+1], v[i+2]};
+        float ds = vDistSq(n, p);
+        if(ds < f*f)
+        {
+            ds = vDist(n, p);
+            vNorm(&n);
+            const float sr = f-ds;
+            vMulS(&n, n, sr);
+            if(sr > 0.03f){damage++;}
+            v[i]   -= n.x;
+            v[i+1] -= n.y;
+            v[i+2] -= n.z;
+            c[i]   -= 0.2f;
+            c[i+1] -= 0.2f;
+            c[i+2] -= 0.2f;
+        }
+    }
+    return damage;
+}
+
+void fibSphere(float* v, float* c, const size_t numvert)
+{
+    const float ga = PI * (3.f - sqrtf(5.f));
+    for(size_t i = 0; i < numvert; i++)
+    {
+        const float z = 1.f - (2.f * (float)i + 1.f) / (float)numvert;
+        const float r = sqrtf(1.f - z*z);
+        const float h = 1.1f + randfc()*0.01f;
+        v[i*3]   = cosf(ga * (float)i) * r * h;
+        v[i*3+1] = sinf(ga * (float)i) * r * h;
+        v[i*3+2] = z * h;
+        c[i*3] = c[i*3+1] = c[i*3+2] = 0.5f + randf()*0.5f;
+    }
+}
+
+int run(const size_t numvert, const unsigned int impacts)
+{
+    const size_t bytes = numvert * 3 * sizeof(float);
+    float* v0 = malloc(bytes);
+    float* c0 = malloc(bytes);
+    float* v1 = malloc(bytes);
+    float* c1 = malloc(bytes);
+    vec* ip = malloc(impacts * sizeof(vec));
+    float* ir = malloc(impacts * sizeof(float));
+    if(!v0 || !c0 || !v1 || !c1 || !ip || !ir){printf("out of memory\n"); return -1;}
+
+    srandf(74235);
+    fibSphere(v0, c0, numvert);
+    memcpy(v1, v0, bytes);
+    memcpy(c1, c0, bytes);
+    for(unsigned int i = 0; i < impacts; i++)
+    {
+        vRuvBT(&ip[i]);
+        vMulS(&ip[i], ip[i], 1.13f);
+        ir[i] = ((0.01f+(randf()*0.07f)) + ((0.16f+(randf()*0.08f))*0.1f))*1.2f;
+    }
+
+    uint64_t st = nanotime();
+    exogrid g;
+    if(egBuild(&g, v1, numvert) < 0){printf("egBuild() failed\n"); return -1;}
+    const uint64_t build = nanotime() - st;
+
+    unsigned int d0 = 0, d1 = 0;
+    st = nanotime();
+    for(unsigned int i = 0; i < impacts; i++)
+        d0 += linearImpact(v0, c0, numvert, ip[i], ir[i]);
+    const uint64_t linear = nanotime() - st;
+
+    st = nanotime();
+    for(unsigned int i = 0; i < impacts; i++)
+        d1 += egImpact(&g, v1, c1, ip[i], ir[i]);
+    const uint64_t grid = nanotime() - st;
+
+    float md = 0.f;
+    for(size_t i = 0; i < numvert*3; i++)
+    {
+        const float d = fabsf(v0[i] - v1[i]);
+        if(d > md){md = d;}
+    }
+#ifdef __FAST_MATH__
+    const int same = d0 == d1 && md < 1e-4f && memcmp(c0, c1, bytes) == 0;
+#else
+    const int same = d0 == d1 && memcmp(v0, v1, bytes) == 0 && memcmp(c0, c1, bytes) == 0;
+#endif
+    printf("%8zu verts | build %8.3f ms | linear %9.2f us/impact | exogrid %7.2f us/impact | x%-7.1f | damage %u/%u | max dev %g %s\n",
+        numvert, (double)build*1e-6, (double)linear*1e-3/impacts, (double)grid*1e-3/impacts,
+        (double)linear/(double)grid, d0, d1, md, same ? "match" : "MISMATCH");
+
+    egFree(&g);
+    free(v0); free(c0); free(v1); free(c1); free(ip); free(ir);
+    return same ? 0 : -1;
+}
+
+int main(int argc, char** argv)
+{
+    size_t numvert = 40962; // EXO_LEVEL, then the next level up
+    unsigned int impacts = 2000;
+    if(argc >= 2){numvert = atoll(argv[1]);}
+    if(argc >= 3){impacts = atoi(argv[2]);}
+
+    int r = run(numvert, impacts);
+    r |= run((numvert-2)*4 + 2, impacts); // the icosphere one level finer
+    return r == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
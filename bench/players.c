@@ -0,0 +1,127 @@
+/*
+    Player vs comet collision benchmark.
+
+    The old code tested the local player in the comet
+    loop and then every online player against every
+    comet in a second scalar loop, here both are done
+    the old way (with the comet scale fixed to [k]) and
+    through the batched csPlayers() kernel for 31 online
+    players and comet counts from 64 to 4096. Both have
+    to flag the same comets and the same local pops.
+
+    make bench_players && ./bench/players [passes]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#define SEIR_RAND
+
+#include "../inc/vec.h"
+#include "../inc/comets.h"
+
+#define NUM_PLAYERS 32 // us and 31 online
+
+uint64_t nanotime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+// the two scalar loops from main_loop()
+unsigned int scalar(const cstore* c, const float* p, unsigned char* out)
+{
+    unsigned int nh = 0;
+    for(unsigned int i = 0; i < c->n; i++)
+    {
+        out[i] = 0;
+        if(c->speed[i] <= 0.f){continue;}
+        const float cs = c->scale[i]+0.06f;
+        if(vDistSq((vec){p[0], p[1], p[2]}, csPos(c, i)) < cs*cs)
+            out[i] = CS_NEAR_LOCAL;
+    }
+    for(unsigned int j = 1; j < NUM_PLAYERS; j++)
+    {
+        for(unsigned int k = 0; k < c->n; k++)
+        {
+            if(c->speed[k] <= 0.f){continue;}
+            const float cd = vDistSq((vec){p[j*3], p[j*3+1], p[j*3+2]}, csPos(c, k));
+            const float cs = c->scale[k]+0.06f;
+            if(cd < cs*cs)
+                out[k] |= CS_NEAR_REMOTE;
+        }
+    }
+    for(unsigned int i = 0; i < c->n; i++)
+        nh += out[i] != 0;
+    return nh;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int passes = 2000;
+    if(argc >= 2){passes = atoi(argv[1]);}
+
+    // players hang around just above the planet, where the comets come in
+    float p[NUM_PLAYERS*3];
+    srandf(74235);
+    for(unsigned int j = 0; j < NUM_PLAYERS; j++)
+    {
+        vec v;
+        vRuvBT(&v);
+        vMulS(&v, v, 1.2f + randf()*0.3f);
+        p[j*3] = v.x; p[j*3+1] = v.y; p[j*3+2] = v.z;
+    }
+
+    int r = 0;
+    for(unsigned int n = 64; n <= 4096; n *= 2)
+    {
+        cstore c;
+        unsigned char* ref = malloc(n);
+        if(ref == NULL || csInit(&c, n) < 0)
+        {
+            printf("out of memory\n");
+            return EXIT_FAILURE;
+        }
+        for(unsigned int i = 0; i < n; i++)
+        {
+            vec v;
+            vRuvBT(&v);
+            vMulS(&v, v, 1.14f + randf()*0.5f);
+            csSetPos(&c, i, v);
+            c.scale[i] = 0.01f+(randf()*0.07f);
+            c.speed[i] = randf() < 0.8f ? 0.16f : 0.f;
+        }
+
+        unsigned int h0 = 0, h1 = 0;
+        uint64_t st = nanotime();
+        for(unsigned int i = 0; i < passes; i++)
+            h0 = scalar(&c, p, ref);
+        const uint64_t old = nanotime() - st;
+
+        st = nanotime();
+        for(unsigned int i = 0; i < passes; i++)
+            h1 = csPlayers(&c, p, NUM_PLAYERS, 0.06f);
+        const uint64_t batch = nanotime() - st;
+
+        int same = h0 == h1;
+        for(unsigned int i = 0; i < n; i++)
+            if((ref[i] != 0) != (c.near[i] != 0) || (ref[i] & CS_NEAR_LOCAL) != (c.near[i] & CS_NEAR_LOCAL))
+                same = 0;
+        if(same == 0){r = -1;}
+        printf("%5u comets | scalar %9.2f us | csPlayers %8.2f us | x%-6.1f | hit %u/%u %s\n",
+            n, (double)old*1e-3/passes, (double)batch*1e-3/passes, (double)old/(double)batch,
+            h0, h1, same ? "match" : "MISMATCH");
+
+        csFree(&c);
+        free(ref);
+    }
+    return r == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
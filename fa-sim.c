@@ -0,0 +1,216 @@
+/*
+    Headless Fractal Attack simulation.
+
+    Runs the same simulation as the game, inc/sim.h, for
+    a given start epoch without a window or a GPU and as
+    fast as the cpu allows. The local player idles at its
+    spawn point and there are no online players.
+
+    Given a file name the final state is also saved as
+    a snapshot to it, played on for ten seconds, restored
+    and saved again; the two snapshots, the restored
+    state and the ten seconds played again from the
+    restore all have to match bit for bit.
+
+    With -r it replays a game log recorded by the game
+    instead, checking the local player position after
+    every tick and the state hash at every checkpoint
+    against the recording.
+
+    make fa-sim && ./fa-sim <start epoch> [ticks] [snapshot file]
+                   ./fa-sim -r <game log> [ticks]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#ifndef __x86_64__
+    #define NOSSE
+#endif
+
+#define SEIR_RAND
+
+#include "inc/sim.h"
+#include "inc/snapshot.h"
+#include "inc/replay.h"
+
+float no_players[MAX_PLAYERS*3] = {0};
+
+uint64_t nanotime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+// save, play on, restore over that and save again, then play on again from the restore
+int snapshotTest(const char* file)
+{
+    const size_t cap = simSaveSize();
+    unsigned char* s0 = malloc(cap);
+    unsigned char* s1 = malloc(cap);
+    float* v = malloc(exo_numvert * 3 * sizeof(float));
+    float* c = malloc(exo_numvert * 3 * sizeof(float));
+    if(s0 == NULL || s1 == NULL || v == NULL || c == NULL){printf("out of memory\n"); return -1;}
+
+    uint64_t st = nanotime();
+    const size_t l0 = simSave(s0, cap);
+    const uint64_t save_ns = nanotime() - st;
+
+    FILE* f = fopen(file, "wb");
+    if(f == NULL || fwrite(s0, 1, l0, f) != l0){printf("could not write %s\n", file); return -1;}
+    fclose(f);
+
+    // remember what was saved, then play on from it
+    const size_t bytes = exo_numvert * 3 * sizeof(float);
+    memcpy(v, exo_vertices, bytes);
+    memcpy(c, exo_colors, bytes);
+    const unsigned int d = damage, h = hits, p = popped;
+    const uint64_t t = sim_tick, ch = comet_hash, sh = simHash();
+    const float cx = comets.px[NUM_COMETS-1], cs = comets.speed[NUM_COMETS-1];
+    siminput in;
+    memset(&in, 0, sizeof(siminput));
+    in.players = no_players;
+    for(unsigned int i = 0; i < SIM_HZ*10; i++)
+        simTick(&in);
+    const uint64_t ah = simHash();
+    const unsigned int ad = damage;
+
+    st = nanotime();
+    const int r = simLoad(s0, l0);
+    const uint64_t load_ns = nanotime() - st;
+    const size_t l1 = simSave(s1, cap);
+
+    float md = 0.f;
+    for(size_t i = 0; i < (size_t)exo_numvert*3; i++)
+    {
+        const float e = fabsf(v[i] - exo_vertices[i]);
+        if(e > md){md = e;}
+    }
+    int same = r == 0 && l0 == l1 && memcmp(s0, s1, l0) == 0 && memcmp(v, exo_vertices, bytes) == 0 && memcmp(c, exo_colors, bytes) == 0 &&
+               d == damage && h == hits && p == popped && t == sim_tick && ch == comet_hash && sh == simHash() &&
+               cx == comets.px[NUM_COMETS-1] && cs == comets.speed[NUM_COMETS-1] && md == 0.f;
+
+    // the restored game has to go the same way the saved one went
+    for(unsigned int i = 0; i < SIM_HZ*10; i++)
+        simTick(&in);
+    same = same && ah == simHash() && ad == damage;
+    printf("snapshot: %zu bytes (%zu for a raw copy), save %.1f us, load %.1f us, max vertex error %g, round trip %s\n",
+        l0, bytes*2, (double)save_ns*1e-3, (double)load_ns*1e-3, md, same ? "ok" : "FAILED");
+    free(s0); free(s1); free(v); free(c);
+    return same ? 0 : -1;
+}
+
+// same mesh preparation as main()
+int makeExo()
+{
+    if(exoInit(EXO_LEVEL) < 0)
+    {
+        printf("exoInit() failed.\n");
+        return -1;
+    }
+    for(size_t i = 0; i < (size_t)exo_numvert*3; i++)
+        exo_vertices[i] *= GFX_SCALE;
+    simExo();
+    return 0;
+}
+
+// replays a game log, returns the number of ticks run or -1 on a mismatch
+int64_t replayLog(const char* file, const uint64_t max_ticks)
+{
+    replay r;
+    if(rpOpen(&r, file) < 0)
+    {
+        printf("%s is not a game log for this build.\n", file);
+        return -1;
+    }
+    if(simInit(r.epoch) < 0)
+    {
+        printf("simInit() failed.\n");
+        return -1;
+    }
+    printf("epoch:    %u\n", r.epoch);
+
+    uint64_t bad_ppr = 0, bad_hash = 0, first_bad = 0;
+    int t = 0;
+    while(sim_tick < max_ticks && (t = rpNext(&r)) > 0)
+    {
+        if(t == 'T')
+        {
+            simTick(&r.in);
+            if(ppr.x != r.ppr.x || ppr.y != r.ppr.y || ppr.z != r.ppr.z)
+            {
+                if(bad_ppr + bad_hash == 0){first_bad = sim_tick;}
+                bad_ppr++;
+            }
+        }
+        else if(t == 'H' && r.hash != simHash())
+        {
+            if(bad_ppr + bad_hash == 0){first_bad = sim_tick;}
+            bad_hash++;
+        }
+    }
+    if(t < 0){printf("%s is cut short after %lu ticks.\n", file, (unsigned long)r.ticks);}
+    rpClose(&r);
+
+    if(bad_ppr + bad_hash > 0)
+    {
+        printf("replay:   DIVERGED at tick %lu, %lu player positions and %lu hashes differ\n",
+            (unsigned long)first_bad, (unsigned long)bad_ppr, (unsigned long)bad_hash);
+        return -1;
+    }
+    printf("replay:   every tick matches the recording\n");
+    return sim_tick;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2 || (strcmp(argv[1], "-r") == 0 && argc < 3))
+    {
+        printf("Usage: ./fa-sim <start epoch> [ticks, default %u] [snapshot file, - = none]\n", SIM_HZ*60*10);
+        printf("       ./fa-sim -r <game log> [ticks, default all]\n");
+        return EXIT_FAILURE;
+    }
+    const int rp = strcmp(argv[1], "-r") == 0;
+    const int sepoch = rp ? 0 : atoi(argv[1]);
+    uint64_t ticks = rp ? UINT64_MAX : SIM_HZ*60*10;
+    if(argc >= 3+rp){ticks = strtoull(argv[2+rp], NULL, 10);}
+
+    if(makeExo() < 0){return EXIT_FAILURE;}
+
+    const uint64_t st = nanotime();
+    if(rp)
+    {
+        const int64_t r = replayLog(argv[2], ticks);
+        if(r < 0){return EXIT_FAILURE;}
+        ticks = r;
+    }
+    else
+    {
+        if(simInit(sepoch) < 0)
+        {
+            printf("simInit() failed.\n");
+            return EXIT_FAILURE;
+        }
+        siminput in;
+        memset(&in, 0, sizeof(siminput));
+        in.players = no_players;
+        for(uint64_t i = 0; i < ticks; i++)
+            simTick(&in);
+    }
+    const double secs = (double)(nanotime() - st) * 1e-9;
+
+    const unsigned int max_damage = exo_numvert/2;
+    printf("ticks:    %lu (%.2f mins of game time)\n", (unsigned long)ticks, (double)ticks/SIM_HZ/60.0);
+    printf("time:     %.3f s, %.0f ticks/sec, x%.1f realtime\n", secs, (double)ticks/secs, (double)ticks/SIM_HZ/secs);
+    printf("damage:   %u/%u (%.2f%%)%s\n", damage, max_damage, (100.f/(float)max_damage)*(float)damage, damage >= max_damage ? " GAME END" : "");
+    printf("hits:     %u\n", hits);
+    printf("popped:   %u\n", popped);
+    printf("hash:     %016lx\n", (unsigned long)simHash());
+    if(!rp && argc >= 4 && strcmp(argv[3], "-") != 0 && snapshotTest(argv[3]) < 0)
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -2,6 +2,8 @@
 
     # https://github.com/mrbid/FractalAttackOnline
 
+    define('LATE_JOIN_SECS', 3600); # late joins catch up, make checks it against main.c
+
     if(!isset($_GET['u']) || !isset($_GET['r']))
     {
         //echo "uid (u) or game-id (r) not provided";
@@ -26,6 +28,30 @@
             exit;
         }
         file_put_contents($_GET['r'] . "/" . $_GET['u'], $_GET['p'], LOCK_EX);
+
+        # simulation hash checkpoint, t = seconds of sim time, h = state hash
+        # kept outside of the game-id dir so positions are all that is echoed
+        if(isset($_GET['t']) && isset($_GET['h']))
+        {
+            $t = intval($_GET['t']);
+            $h = substr(preg_replace('/[^0-9A-F]/', '', strtoupper($_GET['h'])), 0, 8);
+            $hd = $_GET['r'] . "h";
+            $mf = $hd . "/" . $_GET['u'];
+            $last = file_exists($mf) ? intval(file_get_contents($mf)) : 0;
+            if($t > $last && $h != "" && is_dir($hd)) # once per checkpoint
+            {
+                $ar = glob($hd . '/*');
+                foreach($ar as $k)
+                {
+                    if(basename($k) == $_GET['u']){continue;}
+                    $o = explode(" ", file_get_contents($k));
+                    if(count($o) == 2 && intval($o[0]) == $t && $o[1] != $h)
+                        error_log("desync: game " . $_GET['r'] . " at " . $t . "s, uid " . $_GET['u'] . " " . $h . " != uid " . basename($k) . " " . $o[1]);
+                }
+                file_put_contents($mf, $t . " " . $h, LOCK_EX);
+            }
+        }
+
         $ar = glob($_GET['r'] . '/*');
         foreach($ar as $k)
         {
@@ -36,7 +62,7 @@
     }
     else if(isset($_GET['r']))
     {
-        if(time() > $_GET['r'])
+        if(time() > $_GET['r'] + LATE_JOIN_SECS)
         {
             //echo "registration rejected: time period expired";
             header("HTTP/1.1 200 OK");
@@ -59,6 +85,7 @@
             exit;
         }
         mkdir($_GET['r']);
+        @mkdir($_GET['r'] . "h");
         file_put_contents($_GET['r'] . "/" . $_GET['u'], "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", LOCK_EX);
         header("HTTP/1.1 200 OK");
         exit;
@@ -0,0 +1,146 @@
+/*
+    Hashed uniform grid broad phase for the comets.
+
+    Each comet sits in the hash bucket of the grid cell
+    its position falls in, buckets are intrusive doubly
+    linked lists so cgMove() is O(1) and can be called
+    every time a comet position changes; the grid is then
+    always exact and a query returns every comet that
+    could be within r of a point. The caller still does
+    the exact distance test on the candidates so the set
+    of colliding pairs is the same as a brute force scan.
+
+    Requires:
+        - vec.h
+*/
+
+#ifndef CGRID_H
+#define CGRID_H
+
+#include <stdlib.h>
+#include "vec.h"
+
+#define CG_NONE 0xFFFFFFFF
+#define CG_MAX_QUERY_CELLS 64
+
+typedef struct
+{
+    float rcell;            // 1 / cell size
+    unsigned int n;         // number of comets
+    unsigned int mask;      // hash table size - 1
+    unsigned int* head;     // first comet in each bucket
+    unsigned int* next;     // per comet links
+    unsigned int* prev;
+    unsigned int* bucket;   // bucket of each comet
+} cgrid;
+
+int  cgInit(cgrid* g, const unsigned int n, const float cell);
+void cgFree(cgrid* g);
+void cgMove(cgrid* g, const unsigned int i, const vec p);
+unsigned int cgQuery(const cgrid* g, const vec p, const float r, unsigned int* out);
+
+//
+
+static inline unsigned int cgHash(const cgrid* g, const int x, const int y, const int z)
+{
+    return ((unsigned int)x*73856093u ^ (unsigned int)y*19349663u ^ (unsigned int)z*83492791u) & g->mask;
+}
+
+static inline int cgCoord(const cgrid* g, const float f)
+{
+    return (int)floorf(f * g->rcell);
+}
+
+int cgInit(cgrid* g, const unsigned int n, const float cell)
+{
+    unsigned int ts = 64;
+    while(ts < n*2){ts <<= 1;}
+    g->rcell = 1.f / cell;
+    g->n = n;
+    g->mask = ts-1;
+    g->head   = malloc(ts * sizeof(unsigned int));
+    g->next   = malloc(n * sizeof(unsigned int));
+    g->prev   = malloc(n * sizeof(unsigned int));
+    g->bucket = malloc(n * sizeof(unsigned int));
+    if(g->head == NULL || g->next == NULL || g->prev == NULL || g->bucket == NULL)
+    {
+        cgFree(g);
+        return -1;
+    }
+    memset(g->head, 0xFF, ts * sizeof(unsigned int));
+    memset(g->bucket, 0xFF, n * sizeof(unsigned int));
+    return 0;
+}
+
+void cgFree(cgrid* g)
+{
+    free(g->head);
+    free(g->next);
+    free(g->prev);
+    free(g->bucket);
+    memset(g, 0, sizeof(cgrid));
+}
+
+// call whenever comet i changes position, inserts it on first call
+void cgMove(cgrid* g, const unsigned int i, const vec p)
+{
+    const unsigned int b = cgHash(g, cgCoord(g, p.x), cgCoord(g, p.y), cgCoord(g, p.z));
+    const unsigned int o = g->bucket[i];
+    if(b == o){return;}
+
+    // unlink
+    if(o != CG_NONE)
+    {
+        if(g->prev[i] != CG_NONE){g->next[g->prev[i]] = g->next[i];}
+        else{g->head[o] = g->next[i];}
+        if(g->next[i] != CG_NONE){g->prev[g->next[i]] = g->prev[i];}
+    }
+
+    // link at the head of the new bucket
+    g->prev[i] = CG_NONE;
+    g->next[i] = g->head[b];
+    if(g->head[b] != CG_NONE){g->prev[g->head[b]] = i;}
+    g->head[b] = i;
+    g->bucket[i] = b;
+}
+
+// writes every comet that may be within r of p to out (size n), returns the count
+unsigned int cgQuery(const cgrid* g, const vec p, const float r, unsigned int* out)
+{
+    // pad the box a touch so rounding can never drop a cell
+    const float pr = r + 1e-4f;
+    const int x0 = cgCoord(g, p.x-pr), x1 = cgCoord(g, p.x+pr);
+    const int y0 = cgCoord(g, p.y-pr), y1 = cgCoord(g, p.y+pr);
+    const int z0 = cgCoord(g, p.z-pr), z1 = cgCoord(g, p.z+pr);
+
+    // huge radius, everything is a candidate
+    if((x1-x0+1)*(y1-y0+1)*(z1-z0+1) > CG_MAX_QUERY_CELLS)
+    {
+        for(unsigned int i = 0; i < g->n; i++)
+            out[i] = i;
+        return g->n;
+    }
+
+    // different cells can share a bucket, visit each bucket once
+    unsigned int bl[CG_MAX_QUERY_CELLS];
+    unsigned int nb = 0, nc = 0;
+    for(int x = x0; x <= x1; x++)
+    {
+        for(int y = y0; y <= y1; y++)
+        {
+            for(int z = z0; z <= z1; z++)
+            {
+                const unsigned int b = cgHash(g, x, y, z);
+                unsigned int k = 0;
+                while(k < nb && bl[k] != b){k++;}
+                if(k < nb){continue;}
+                bl[nb++] = b;
+                for(unsigned int i = g->head[b]; i != CG_NONE; i = g->next[i])
+                    out[nc++] = i;
+            }
+        }
+    }
+    return nc;
+}
+
+#endif
@@ -0,0 +1,390 @@
+/*
+    Clustered index buffer for the exo shells.
+
+    ecBuild() sorts the triangles into patches by the cube
+    face and cell their centroid direction falls in, about
+    EC_TRIS triangles to a patch, and writes the index
+    buffer again patch after patch. Each patch keeps a
+    bounding sphere and a cone around the normals of its
+    triangles, so one test a patch says if any triangle in
+    it can face the eye, and clVisible() from cull.h says
+    if the sphere is in the frustum and not behind the
+    planet. ecSelect() makes the list of index ranges to
+    draw, neighbouring patches that both pass merge into
+    one range, and ecDraw() sends it as one
+    glMultiDrawElements, or one glDrawElements a range
+    without GL 1.4.
+
+    Craters move vertices, ecMark() flags the patches a
+    crater sphere touches and ecRefresh() works their
+    bounds out again from the moved vertices before the
+    next ecSelect(). ecClone() gives a second mesh of the
+    same triangles, the inner shell, its own bounds over
+    the same index buffer.
+
+    The normals are the winding ones, (b-a)x(c-a), so a
+    patch is dropped only when GL_CULL_FACE would drop
+    every triangle in it anyway.
+
+    ecUnder() gives a mesh the vertices of the shell under
+    it, the same vertices before any crater; craters push
+    vertices straight in, so a patch is breached once one
+    of its vertices sinks to EC_BREACH times its twin in
+    the shell under it, and stays so. ecRefresh() checks
+    the patches it redoes and ecSelect() can be limited to
+    the breached ones, the under shell only shows there.
+
+    Requires:
+        - vec.h
+        - cull.h
+*/
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vec.h"
+#include "cull.h"
+
+#define EC_TRIS 256 // target triangles a patch
+#define EC_BREACH 1.005f // how close to the shell under it counts as through
+
+typedef struct
+{
+    vec c;
+    float r;            // bounding sphere
+    vec axis;
+    float cone;         // normal cone half angle, d2PI or more and it always faces somewhere
+    unsigned int first; // into the index buffer, in indices
+    unsigned int count;
+} ecluster;
+
+typedef struct
+{
+    ecluster* k;
+    unsigned int n;
+    GLuint* indices;        // patch ordered, shared with clones
+    size_t numind;
+    unsigned char* dirty;
+    unsigned int ndirty;
+    GLsizei* counts;        // the last ecSelect()
+    const void** offsets;
+    unsigned int nranges;
+    unsigned int owner;     // 1 if indices are ours to free
+    const float* under;     // vertices of the shell under this one, or NULL
+    unsigned char* breached;
+    unsigned int nbreached;
+} ecmesh;
+
+int  ecBuild(ecmesh* m, const float* v, const GLuint* indices, const size_t numind);
+int  ecClone(ecmesh* m, const ecmesh* src, const float* v);
+void ecBounds(ecmesh* m, const float* v, const unsigned int k);
+void ecBreach(ecmesh* m, const float* v, const unsigned int k);
+void ecMark(ecmesh* m, const vec p, const float f);
+void ecMarkAll(ecmesh* m);
+void ecRefresh(ecmesh* m, const float* v);
+int  ecUnder(ecmesh* m, const float* v, const float* under);
+unsigned int ecSelect(ecmesh* m, const clview* cv, const unsigned char* only);
+unsigned int ecDraw(const ecmesh* m);
+void ecFree(ecmesh* m);
+
+//
+
+static inline unsigned int ecCell(const float x, const float y, const float z, const unsigned int cells)
+{
+    // cube face of the direction, then an even angle grid on it
+    const float ax = fabsf(x), ay = fabsf(y), az = fabsf(z);
+    unsigned int face;
+    float u, w, mj;
+    if(ax >= ay && ax >= az){face = x < 0.f; u = y; w = z; mj = ax;}
+    else if(ay >= az)       {face = 2 + (y < 0.f); u = x; w = z; mj = ay;}
+    else                    {face = 4 + (z < 0.f); u = x; w = y; mj = az;}
+    if(mj == 0.f){return 0;}
+    u = atanf(u / mj) * (4.f/PI);
+    w = atanf(w / mj) * (4.f/PI);
+    int cu = (int)((u + 1.f) * 0.5f * cells);
+    int cw = (int)((w + 1.f) * 0.5f * cells);
+    if(cu < 0){cu = 0;} else if(cu >= (int)cells){cu = cells-1;}
+    if(cw < 0){cw = 0;} else if(cw >= (int)cells){cw = cells-1;}
+    return (face * cells + cw) * cells + cu;
+}
+
+int ecAlloc(ecmesh* m, const unsigned int n)
+{
+    m->n = n;
+    m->k = calloc(n, sizeof(ecluster));
+    m->dirty = calloc(n, 1);
+    m->counts = malloc(n * sizeof(GLsizei));
+    m->offsets = malloc(n * sizeof(void*));
+    m->ndirty = 0;
+    m->nranges = 0;
+    if(m->k == NULL || m->dirty == NULL || m->counts == NULL || m->offsets == NULL){return -1;}
+    return 0;
+}
+
+// returns 0 on success, -1 out of memory
+int ecBuild(ecmesh* m, const float* v, const GLuint* indices, const size_t numind)
+{
+    memset(m, 0, sizeof(ecmesh));
+    const size_t nt = numind / 3;
+    unsigned int cells = (unsigned int)(sqrtf((float)nt / (6.f * EC_TRIS)) + 0.5f);
+    if(cells < 1){cells = 1;}
+    const unsigned int nc = 6 * cells * cells;
+
+    unsigned int* tc = malloc(nt * sizeof(unsigned int));
+    unsigned int* start = calloc(nc+1, sizeof(unsigned int));
+    m->indices = malloc(numind * sizeof(GLuint));
+    m->numind = numind;
+    m->owner = 1;
+    if(tc == NULL || start == NULL || m->indices == NULL || ecAlloc(m, nc) < 0)
+    {
+        free(tc);
+        free(start);
+        ecFree(m);
+        return -1;
+    }
+
+    // counting sort of the triangles into their patches
+    for(size_t t = 0; t < nt; t++)
+    {
+        const float* a = &v[indices[t*3]*3];
+        const float* b = &v[indices[t*3+1]*3];
+        const float* c = &v[indices[t*3+2]*3];
+        tc[t] = ecCell(a[0]+b[0]+c[0], a[1]+b[1]+c[1], a[2]+b[2]+c[2], cells);
+        start[tc[t]+1]++;
+    }
+    for(unsigned int i = 0; i < nc; i++)
+        start[i+1] += start[i];
+    for(unsigned int i = 0; i < nc; i++)
+    {
+        m->k[i].first = start[i]*3;
+        m->k[i].count = (start[i+1]-start[i])*3;
+    }
+    for(size_t t = 0; t < nt; t++)
+    {
+        const unsigned int o = start[tc[t]]++;
+        memcpy(&m->indices[o*3], &indices[t*3], 3*sizeof(GLuint));
+    }
+    free(tc);
+    free(start);
+
+    for(unsigned int i = 0; i < nc; i++)
+        ecBounds(m, v, i);
+    return 0;
+}
+
+// same patches as src over the vertices v, returns 0 on success
+int ecClone(ecmesh* m, const ecmesh* src, const float* v)
+{
+    memset(m, 0, sizeof(ecmesh));
+    if(ecAlloc(m, src->n) < 0){ecFree(m); return -1;}
+    m->indices = src->indices;
+    m->numind = src->numind;
+    for(unsigned int i = 0; i < m->n; i++)
+    {
+        m->k[i].first = src->k[i].first;
+        m->k[i].count = src->k[i].count;
+        ecBounds(m, v, i);
+    }
+    return 0;
+}
+
+void ecBounds(ecmesh* m, const float* v, const unsigned int k)
+{
+    ecluster* e = &m->k[k];
+    e->c = (vec){0.f, 0.f, 0.f};
+    e->r = 0.f;
+    e->axis = (vec){0.f, 0.f, 0.f};
+    e->cone = PI;
+    if(e->count == 0){return;}
+    const GLuint* ind = &m->indices[e->first];
+
+    // sphere around the box centre, normal cone around the mean normal
+    vec lo = {1e30f, 1e30f, 1e30f}, hi = {-1e30f, -1e30f, -1e30f};
+    for(unsigned int i = 0; i < e->count; i++)
+    {
+        const float* p = &v[ind[i]*3];
+        if(p[0] < lo.x){lo.x = p[0];} if(p[0] > hi.x){hi.x = p[0];}
+        if(p[1] < lo.y){lo.y = p[1];} if(p[1] > hi.y){hi.y = p[1];}
+        if(p[2] < lo.z){lo.z = p[2];} if(p[2] > hi.z){hi.z = p[2];}
+    }
+    e->c = (vec){(lo.x+hi.x)*0.5f, (lo.y+hi.y)*0.5f, (lo.z+hi.z)*0.5f};
+    float r2 = 0.f;
+    for(unsigned int i = 0; i < e->count; i++)
+    {
+        const float* p = &v[ind[i]*3];
+        const float d2 = vDistSq((vec){p[0], p[1], p[2]}, e->c);
+        if(d2 > r2){r2 = d2;}
+    }
+    e->r = sqrtf(r2);
+
+    vec sum = {0.f, 0.f, 0.f};
+    for(unsigned int i = 0; i < e->count; i += 3)
+    {
+        const float* a = &v[ind[i]*3];
+        const float* b = &v[ind[i+1]*3];
+        const float* c = &v[ind[i+2]*3];
+        vec n;
+        vCross(&n, (vec){b[0]-a[0], b[1]-a[1], b[2]-a[2]}, (vec){c[0]-a[0], c[1]-a[1], c[2]-a[2]});
+        const float l = vMod(n);
+        if(l == 0.f){continue;}
+        sum.x += n.x / l;
+        sum.y += n.y / l;
+        sum.z += n.z / l;
+    }
+    const float sl = vMod(sum);
+    if(sl == 0.f){return;}
+    e->axis = (vec){sum.x / sl, sum.y / sl, sum.z / sl};
+    float mind = 1.f;
+    for(unsigned int i = 0; i < e->count; i += 3)
+    {
+        const float* a = &v[ind[i]*3];
+        const float* b = &v[ind[i+1]*3];
+        const float* c = &v[ind[i+2]*3];
+        vec n;
+        vCross(&n, (vec){b[0]-a[0], b[1]-a[1], b[2]-a[2]}, (vec){c[0]-a[0], c[1]-a[1], c[2]-a[2]});
+        const float l = vMod(n);
+        if(l == 0.f){continue;}
+        const float d = vDot(n, e->axis) / l;
+        if(d < mind){mind = d;}
+    }
+    e->cone = acosf(mind < -1.f ? -1.f : mind);
+}
+
+void ecBreach(ecmesh* m, const float* v, const unsigned int k)
+{
+    if(m->breached[k] == 1){return;}
+    const ecluster* e = &m->k[k];
+    const GLuint* ind = &m->indices[e->first];
+    for(unsigned int i = 0; i < e->count; i++)
+    {
+        const float* p = &v[ind[i]*3];
+        const float* u = &m->under[ind[i]*3];
+        const float pp = p[0]*p[0] + p[1]*p[1] + p[2]*p[2];
+        const float uu = u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
+        if(pp < uu * (EC_BREACH*EC_BREACH))
+        {
+            m->breached[k] = 1;
+            m->nbreached++;
+            return;
+        }
+    }
+}
+
+// a crater of radius f at p, the patches it reaches need new bounds
+void ecMark(ecmesh* m, const vec p, const float f)
+{
+    for(unsigned int i = 0; i < m->n; i++)
+    {
+        if(m->dirty[i] == 1){continue;}
+        const float rr = m->k[i].r + f;
+        if(vDistSq(m->k[i].c, p) < rr*rr)
+        {
+            m->dirty[i] = 1;
+            m->ndirty++;
+        }
+    }
+}
+
+void ecMarkAll(ecmesh* m)
+{
+    memset(m->dirty, 1, m->n);
+    m->ndirty = m->n;
+}
+
+void ecRefresh(ecmesh* m, const float* v)
+{
+    if(m->ndirty == 0){return;}
+    for(unsigned int i = 0; i < m->n; i++)
+    {
+        if(m->dirty[i] == 0){continue;}
+        ecBounds(m, v, i);
+        if(m->under != NULL){ecBreach(m, v, i);}
+        m->dirty[i] = 0;
+    }
+    m->ndirty = 0;
+}
+
+// returns 0 on success, -1 out of memory
+int ecUnder(ecmesh* m, const float* v, const float* under)
+{
+    m->breached = calloc(m->n, 1);
+    if(m->breached == NULL){return -1;}
+    m->under = under;
+    m->nbreached = 0;
+    for(unsigned int i = 0; i < m->n; i++)
+        ecBreach(m, v, i);
+    return 0;
+}
+
+// 1 if no triangle of e can face the eye
+static inline int ecBackfacing(const ecluster* e, const vec eye)
+{
+    if(e->cone >= d2PI){return 0;}
+    const vec v = (vec){e->c.x - eye.x, e->c.y - eye.y, e->c.z - eye.z};
+    const float d = vMod(v);
+    if(d <= e->r){return 0;}
+
+    // widest angle from the axis to the eye ray to any point of the sphere, plus the cone
+    float ca = vDot(v, e->axis) / d;
+    if(ca > 1.f){ca = 1.f;} else if(ca < -1.f){ca = -1.f;}
+    return acosf(ca) + asinf(e->r / d) + e->cone <= d2PI;
+}
+
+// builds the draw list from the patches set in only, or all with NULL, returns the triangles in it
+unsigned int ecSelect(ecmesh* m, const clview* cv, const unsigned char* only)
+{
+    unsigned int tris = 0;
+    int open = 0;
+    m->nranges = 0;
+    for(unsigned int i = 0; i < m->n; i++)
+    {
+        const ecluster* e = &m->k[i];
+        if(e->count == 0){continue;}
+        if((only != NULL && only[i] == 0) || ecBackfacing(e, cv->eye) == 1 || clVisible(cv, e->c, e->r) != CL_VISIBLE)
+        {
+            open = 0;
+            continue;
+        }
+        if(open == 1)
+            m->counts[m->nranges-1] += e->count;
+        else
+        {
+            m->counts[m->nranges] = e->count;
+            m->offsets[m->nranges] = (const void*)(size_t)(e->first * sizeof(GLuint));
+            m->nranges++;
+            open = 1;
+        }
+        tris += e->count / 3;
+    }
+    return tris;
+}
+
+// the index buffer has to be bound, returns the gl calls made
+unsigned int ecDraw(const ecmesh* m)
+{
+    if(m->nranges == 0){return 0;}
+    if(glMultiDrawElements != NULL)
+    {
+        glMultiDrawElements(GL_TRIANGLES, m->counts, GL_UNSIGNED_INT, m->offsets, m->nranges);
+        return 1;
+    }
+    for(unsigned int i = 0; i < m->nranges; i++)
+        glDrawElements(GL_TRIANGLES, m->counts[i], GL_UNSIGNED_INT, m->offsets[i]);
+    return m->nranges;
+}
+
+void ecFree(ecmesh* m)
+{
+    free(m->k);
+    free(m->dirty);
+    free(m->counts);
+    free(m->offsets);
+    free(m->breached);
+    if(m->owner == 1){free(m->indices);}
+    memset(m, 0, sizeof(ecmesh));
+}
+
+#endif
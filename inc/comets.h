@@ -0,0 +1,287 @@
+/*
+    Structure of arrays comet store and the per tick
+    comet kernels.
+
+    The three passes over every comet; integration, the
+    planet radius test and the proximity test against
+    every player, run over the arrays a block at a time
+    and use AVX2 when the build targets it, SSE otherwise
+    and plain C for the NOSSE builds. All three paths do the same
+    IEEE operations in the same order per comet so they
+    produce the same positions, hits and CS_NEAR_LOCAL bits.
+    CS_NEAR_REMOTE is not, csPlayers() stops testing early
+    in a different place on each path, so only whether near
+    is 0 and the local bit can be relied on.
+
+    A comet is live while speed > 0, exploding while
+    speed == 0 (dx is then its opacity) and frozen at the
+    end of a game when speed == -1. Lanes past n are kept
+    frozen so the kernels never have to handle a tail.
+
+    Requires:
+        - vec.h
+*/
+
+#ifndef COMETS_H
+#define COMETS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "vec.h"
+
+#if defined(__AVX2__) && !defined(NOSSE)
+    #define CS_WIDTH 8
+#else
+    #define CS_WIDTH 4
+#endif
+
+#define CS_NEAR_LOCAL  1
+#define CS_NEAR_REMOTE 2
+
+typedef struct
+{
+    unsigned int n, cap;        // cap is n rounded up to CS_WIDTH
+    float *px, *py, *pz;        // position
+    float *qx, *qy, *qz;        // position at the start of the last tick
+    float *dx, *dy, *dz;        // direction
+    float *rot, *scale, *speed;
+    unsigned char *hit;         // planet mask from csPlanet()
+    unsigned char *near;        // player mask from csPlayers()
+} cstore;
+
+int  csInit(cstore* c, const unsigned int n);
+void csFree(cstore* c);
+void csIntegrate(cstore* c, const float dt);
+unsigned int csPlanet(cstore* c, const float r);
+unsigned int csPlayers(cstore* c, const float* p, const unsigned int np, const float pad);
+
+static inline vec csPos(const cstore* c, const unsigned int i)
+{
+    return (vec){c->px[i], c->py[i], c->pz[i]};
+}
+
+static inline vec csDir(const cstore* c, const unsigned int i)
+{
+    return (vec){c->dx[i], c->dy[i], c->dz[i]};
+}
+
+static inline void csSetPos(cstore* c, const unsigned int i, const vec p)
+{
+    c->px[i] = p.x;
+    c->py[i] = p.y;
+    c->pz[i] = p.z;
+}
+
+static inline void csSetDir(cstore* c, const unsigned int i, const vec d)
+{
+    c->dx[i] = d.x;
+    c->dy[i] = d.y;
+    c->dz[i] = d.z;
+}
+
+//
+
+int csInit(cstore* c, const unsigned int n)
+{
+    memset(c, 0, sizeof(cstore));
+    c->n = n;
+    c->cap = (n + CS_WIDTH-1) & ~(CS_WIDTH-1);
+    const size_t fs = c->cap * sizeof(float);
+    float** f[] = {&c->px, &c->py, &c->pz, &c->qx, &c->qy, &c->qz, &c->dx, &c->dy, &c->dz, &c->rot, &c->scale, &c->speed};
+    for(unsigned int i = 0; i < sizeof(f)/sizeof(f[0]); i++)
+    {
+        *f[i] = aligned_alloc(32, (fs + 31) & ~31);
+        if(*f[i] == NULL){csFree(c); return -1;}
+        memset(*f[i], 0, fs);
+    }
+    c->hit  = calloc(c->cap, 1);
+    c->near = calloc(c->cap, 1);
+    if(c->hit == NULL || c->near == NULL){csFree(c); return -1;}
+    for(unsigned int i = 0; i < c->cap; i++)
+        c->speed[i] = -1.f;
+    return 0;
+}
+
+void csFree(cstore* c)
+{
+    free(c->px); free(c->py); free(c->pz);
+    free(c->qx); free(c->qy); free(c->qz);
+    free(c->dx); free(c->dy); free(c->dz);
+    free(c->rot); free(c->scale); free(c->speed);
+    free(c->hit); free(c->near);
+    memset(c, 0, sizeof(cstore));
+}
+
+// p += dir * speed * dt for every live comet, last positions go to q
+void csIntegrate(cstore* c, const float dt)
+{
+    memcpy(c->qx, c->px, c->cap * sizeof(float));
+    memcpy(c->qy, c->py, c->cap * sizeof(float));
+    memcpy(c->qz, c->pz, c->cap * sizeof(float));
+#if CS_WIDTH == 8
+    const __m256 vdt = _mm256_set1_ps(dt);
+    const __m256 zero = _mm256_setzero_ps();
+    for(unsigned int i = 0; i < c->cap; i += 8)
+    {
+        const __m256 s = _mm256_load_ps(&c->speed[i]);
+        const __m256 pi = _mm256_and_ps(_mm256_mul_ps(s, vdt), _mm256_cmp_ps(s, zero, _CMP_GT_OQ));
+        _mm256_store_ps(&c->px[i], _mm256_add_ps(_mm256_load_ps(&c->px[i]), _mm256_mul_ps(_mm256_load_ps(&c->dx[i]), pi)));
+        _mm256_store_ps(&c->py[i], _mm256_add_ps(_mm256_load_ps(&c->py[i]), _mm256_mul_ps(_mm256_load_ps(&c->dy[i]), pi)));
+        _mm256_store_ps(&c->pz[i], _mm256_add_ps(_mm256_load_ps(&c->pz[i]), _mm256_mul_ps(_mm256_load_ps(&c->dz[i]), pi)));
+    }
+#elif !defined(NOSSE)
+    const __m128 vdt = _mm_set1_ps(dt);
+    const __m128 zero = _mm_setzero_ps();
+    for(unsigned int i = 0; i < c->cap; i += 4)
+    {
+        const __m128 s = _mm_load_ps(&c->speed[i]);
+        const __m128 pi = _mm_and_ps(_mm_mul_ps(s, vdt), _mm_cmpgt_ps(s, zero));
+        _mm_store_ps(&c->px[i], _mm_add_ps(_mm_load_ps(&c->px[i]), _mm_mul_ps(_mm_load_ps(&c->dx[i]), pi)));
+        _mm_store_ps(&c->py[i], _mm_add_ps(_mm_load_ps(&c->py[i]), _mm_mul_ps(_mm_load_ps(&c->dy[i]), pi)));
+        _mm_store_ps(&c->pz[i], _mm_add_ps(_mm_load_ps(&c->pz[i]), _mm_mul_ps(_mm_load_ps(&c->dz[i]), pi)));
+    }
+#else
+    for(unsigned int i = 0; i < c->cap; i++)
+    {
+        if(c->speed[i] > 0.f)
+        {
+            const float pi = c->speed[i]*dt;
+            c->px[i] += c->dx[i]*pi;
+            c->py[i] += c->dy[i]*pi;
+            c->pz[i] += c->dz[i]*pi;
+        }
+    }
+#endif
+}
+
+// hit[i] = 1 for every live comet closer than r to the origin, returns the count
+unsigned int csPlanet(cstore* c, const float r)
+{
+    unsigned int nh = 0;
+#if CS_WIDTH == 8
+    const __m256 vr = _mm256_set1_ps(r);
+    const __m256 zero = _mm256_setzero_ps();
+    for(unsigned int i = 0; i < c->cap; i += 8)
+    {
+        const __m256 x = _mm256_load_ps(&c->px[i]);
+        const __m256 y = _mm256_load_ps(&c->py[i]);
+        const __m256 z = _mm256_load_ps(&c->pz[i]);
+        const __m256 m = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+        const int b = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(m, vr, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_load_ps(&c->speed[i]), zero, _CMP_GT_OQ)));
+        for(unsigned int k = 0; k < 8; k++)
+            c->hit[i+k] = (b >> k) & 1;
+        nh += __builtin_popcount(b);
+    }
+#elif !defined(NOSSE)
+    const __m128 vr = _mm_set1_ps(r);
+    const __m128 zero = _mm_setzero_ps();
+    for(unsigned int i = 0; i < c->cap; i += 4)
+    {
+        const __m128 x = _mm_load_ps(&c->px[i]);
+        const __m128 y = _mm_load_ps(&c->py[i]);
+        const __m128 z = _mm_load_ps(&c->pz[i]);
+        const __m128 m = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        const int b = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(m, vr), _mm_cmpgt_ps(_mm_load_ps(&c->speed[i]), zero)));
+        for(unsigned int k = 0; k < 4; k++)
+            c->hit[i+k] = (b >> k) & 1;
+        nh += __builtin_popcount(b);
+    }
+#else
+    for(unsigned int i = 0; i < c->cap; i++)
+    {
+        const float x = c->px[i], y = c->py[i], z = c->pz[i];
+        c->hit[i] = c->speed[i] > 0.f && sqrtf(x*x + y*y + z*z) < r;
+        nh += c->hit[i];
+    }
+#endif
+    return nh;
+}
+
+// near[i] has CS_NEAR_LOCAL set if live comet i is within scale+pad of
+// p[0..2], the local player, and CS_NEAR_REMOTE if it is within that of
+// any of the other np-1 positions in p. a block stops testing players
+// once every live comet in it is hit, so only the local bit is exact.
+// returns the number of comets hit.
+unsigned int csPlayers(cstore* c, const float* p, const unsigned int np, const float pad)
+{
+    unsigned int nh = 0;
+#if CS_WIDTH == 8
+    const __m256 vpad = _mm256_set1_ps(pad);
+    const __m256 zero = _mm256_setzero_ps();
+    for(unsigned int i = 0; i < c->cap; i += 8)
+    {
+        const int live = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_load_ps(&c->speed[i]), zero, _CMP_GT_OQ));
+        int lb = 0, rb = 0;
+        if(live != 0)
+        {
+            const __m256 x = _mm256_load_ps(&c->px[i]);
+            const __m256 y = _mm256_load_ps(&c->py[i]);
+            const __m256 z = _mm256_load_ps(&c->pz[i]);
+            const __m256 s = _mm256_add_ps(_mm256_load_ps(&c->scale[i]), vpad);
+            const __m256 s2 = _mm256_mul_ps(s, s);
+            for(unsigned int j = 0; j < np; j++)
+            {
+                const __m256 dx = _mm256_sub_ps(_mm256_set1_ps(p[j*3]), x);
+                const __m256 dy = _mm256_sub_ps(_mm256_set1_ps(p[j*3+1]), y);
+                const __m256 dz = _mm256_sub_ps(_mm256_set1_ps(p[j*3+2]), z);
+                const __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+                const int b = _mm256_movemask_ps(_mm256_cmp_ps(d, s2, _CMP_LT_OQ)) & live;
+                if(j == 0){lb = b;}else{rb |= b;}
+                if((lb | rb) == live){break;}
+            }
+        }
+        for(unsigned int k = 0; k < 8; k++)
+            c->near[i+k] = ((lb >> k) & 1) * CS_NEAR_LOCAL | ((rb >> k) & 1) * CS_NEAR_REMOTE;
+        nh += __builtin_popcount(lb | rb);
+    }
+#elif !defined(NOSSE)
+    const __m128 vpad = _mm_set1_ps(pad);
+    const __m128 zero = _mm_setzero_ps();
+    for(unsigned int i = 0; i < c->cap; i += 4)
+    {
+        const int live = _mm_movemask_ps(_mm_cmpgt_ps(_mm_load_ps(&c->speed[i]), zero));
+        int lb = 0, rb = 0;
+        if(live != 0)
+        {
+            const __m128 x = _mm_load_ps(&c->px[i]);
+            const __m128 y = _mm_load_ps(&c->py[i]);
+            const __m128 z = _mm_load_ps(&c->pz[i]);
+            const __m128 s = _mm_add_ps(_mm_load_ps(&c->scale[i]), vpad);
+            const __m128 s2 = _mm_mul_ps(s, s);
+            for(unsigned int j = 0; j < np; j++)
+            {
+                const __m128 dx = _mm_sub_ps(_mm_set1_ps(p[j*3]), x);
+                const __m128 dy = _mm_sub_ps(_mm_set1_ps(p[j*3+1]), y);
+                const __m128 dz = _mm_sub_ps(_mm_set1_ps(p[j*3+2]), z);
+                const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                const int b = _mm_movemask_ps(_mm_cmplt_ps(d, s2)) & live;
+                if(j == 0){lb = b;}else{rb |= b;}
+                if((lb | rb) == live){break;}
+            }
+        }
+        for(unsigned int k = 0; k < 4; k++)
+            c->near[i+k] = ((lb >> k) & 1) * CS_NEAR_LOCAL | ((rb >> k) & 1) * CS_NEAR_REMOTE;
+        nh += __builtin_popcount(lb | rb);
+    }
+#else
+    for(unsigned int i = 0; i < c->cap; i++)
+    {
+        c->near[i] = 0;
+        if(c->speed[i] <= 0.f){continue;}
+        const float s = c->scale[i] + pad;
+        for(unsigned int j = 0; j < np; j++)
+        {
+            const float x = p[j*3] - c->px[i], y = p[j*3+1] - c->py[i], z = p[j*3+2] - c->pz[i];
+            if(x*x + y*y + z*z < s*s)
+            {
+                c->near[i] = j == 0 ? CS_NEAR_LOCAL : CS_NEAR_REMOTE;
+                break;
+            }
+        }
+        nh += c->near[i] != 0;
+    }
+#endif
+    return nh;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/*
+    Counter based random numbers.
+
+    A stream is a 64 bit key and a counter and the nth
+    number of a stream is a pure function of the two, so
+    any number of any stream can be made without touching
+    the others. The comets key their streams on the epoch,
+    the comet index and how many times that comet has
+    respawned; a respawn no longer depends on every draw
+    that came before it.
+
+    The mix is integers only, two rounds of Chris Wellons'
+    lowbias32 around the key, and floats take the top 24
+    bits so the result is exact on every build. crFill()
+    and crFillC() fill a run of a stream 8 or 4 lanes at a
+    time with AVX2 or SSE, plain C on NOSSE builds, and
+    give the same numbers as the scalar calls; crFillRuv()
+    turns a run into packed unit vectors.
+
+    Requires:
+        - vec.h
+*/
+
+#ifndef CRAND_H
+#define CRAND_H
+
+#include <stdint.h>
+#include "vec.h"
+
+typedef struct
+{
+    uint32_t lo, hi;
+} crkey;
+
+typedef struct
+{
+    crkey k;
+    uint32_t n; // next counter
+} crstream;
+
+static inline crkey    crKey(const uint32_t seed, const uint32_t a, const uint32_t b);
+static inline uint32_t crU32(const crkey k, const uint32_t n);
+static inline crstream crStream(const crkey k);
+static inline float crRandf(crstream* s);  // uniform [0 to 1)
+static inline float crRandfc(crstream* s); // uniform [-1 to 1)
+void crRuvBT(crstream* s, vec* v); // vRuvBT() on a stream
+void crRuvTA(crstream* s, vec* v); // vRuvTA() on a stream
+void crFill(const crkey k, uint32_t n, float* out, const unsigned int count);  // [0 to 1) for counters n to n+count-1
+void crFillC(const crkey k, uint32_t n, float* out, const unsigned int count); // [-1 to 1)
+void crFillRuv(const crkey k, uint32_t n, float* xyz, const unsigned int count); // crRuvBT() for count vectors from counter n
+
+//
+
+#define CR_M0 0x7feb352dU
+#define CR_M1 0x846ca68bU
+#define CR_GOLD 0x9e3779b9U
+
+static inline uint32_t crMix(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= CR_M0;
+    x ^= x >> 15;
+    x *= CR_M1;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline crkey crKey(const uint32_t seed, const uint32_t a, const uint32_t b)
+{
+    const uint32_t lo = crMix(seed ^ crMix(a + CR_GOLD));
+    return (crkey){lo, crMix(lo ^ crMix(b + CR_GOLD*2))};
+}
+
+static inline uint32_t crU32(const crkey k, const uint32_t n)
+{
+    return crMix(crMix(n ^ k.lo) + k.hi);
+}
+
+static inline crstream crStream(const crkey k)
+{
+    return (crstream){k, 0};
+}
+
+static inline float crF(const uint32_t u)
+{
+    return (float)(u >> 8) * (1.f/16777216.f);
+}
+
+static inline float crFC(const uint32_t u)
+{
+    return (float)(u >> 8) * (2.f/16777216.f) - 1.f;
+}
+
+static inline float crRandf(crstream* s)
+{
+    return crF(crU32(s->k, s->n++));
+}
+
+static inline float crRandfc(crstream* s)
+{
+    return crFC(crU32(s->k, s->n++));
+}
+
+void crRuvBT(crstream* s, vec* v)
+{
+    const float y = simacosf(crRandfc(s)) - d2PI;
+    const float p = x2PI * crRandf(s);
+    v->x = simcosf(y) * simcosf(p);
+    v->y = simcosf(y) * simsinf(p);
+    v->z = simsinf(y);
+}
+
+void crRuvTA(crstream* s, vec* v)
+{
+    while(1)
+    {
+        v->x = crRandfc(s);
+        v->y = crRandfc(s);
+        v->z = crRandfc(s);
+        const float len = vMag(*v);
+        if(len <= 1.0f){return;}
+    }
+}
+
+#if defined(__AVX2__) && !defined(NOSSE)
+
+static inline __m256i crMix8(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)CR_M0));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)CR_M1));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+// 8 consecutive counters as floats, top 24 bits * scale + bias
+static inline void crBlock(const crkey k, const uint32_t n, float* out, const float scale, const float bias)
+{
+    __m256i x = _mm256_add_epi32(_mm256_set1_epi32((int)n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    x = crMix8(_mm256_xor_si256(x, _mm256_set1_epi32((int)k.lo)));
+    x = crMix8(_mm256_add_epi32(x, _mm256_set1_epi32((int)k.hi)));
+    const __m256 f = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8));
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_mul_ps(f, _mm256_set1_ps(scale)), _mm256_set1_ps(bias)));
+}
+#define CR_WIDTH 8
+
+#elif !defined(NOSSE)
+
+static inline __m128i crMul4(const __m128i a, const __m128i b)
+{
+#ifdef __SSE4_1__
+    return _mm_mullo_epi32(a, b);
+#else
+    // low 32 bits of the even and odd lane products
+    const __m128i e = _mm_mul_epu32(a, b);
+    const __m128i o = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(e, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(o, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+
+static inline __m128i crMix4(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = crMul4(x, _mm_set1_epi32((int)CR_M0));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = crMul4(x, _mm_set1_epi32((int)CR_M1));
+    return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+// 4 consecutive counters as floats, top 24 bits * scale + bias
+static inline void crBlock(const crkey k, const uint32_t n, float* out, const float scale, const float bias)
+{
+    __m128i x = _mm_add_epi32(_mm_set1_epi32((int)n), _mm_setr_epi32(0, 1, 2, 3));
+    x = crMix4(_mm_xor_si128(x, _mm_set1_epi32((int)k.lo)));
+    x = crMix4(_mm_add_epi32(x, _mm_set1_epi32((int)k.hi)));
+    const __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(x, 8));
+    _mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(scale)), _mm_set1_ps(bias)));
+}
+#define CR_WIDTH 4
+
+#else
+
+static inline void crBlock(const crkey k, const uint32_t n, float* out, const float scale, const float bias)
+{
+    for(uint32_t i = 0; i < 4; i++)
+        out[i] = (float)(crU32(k, n+i) >> 8) * scale + bias;
+}
+#define CR_WIDTH 4
+
+#endif
+
+static inline void crFillS(const crkey k, uint32_t n, float* out, const unsigned int count, const float scale, const float bias)
+{
+    unsigned int i = 0;
+    for(; i + CR_WIDTH <= count; i += CR_WIDTH, n += CR_WIDTH)
+        crBlock(k, n, out+i, scale, bias);
+    for(; i < count; i++, n++)
+        out[i] = (float)(crU32(k, n) >> 8) * scale + bias;
+}
+
+void crFill(const crkey k, uint32_t n, float* out, const unsigned int count)
+{
+    crFillS(k, n, out, count, 1.f/16777216.f, 0.f);
+}
+
+void crFillC(const crkey k, uint32_t n, float* out, const unsigned int count)
+{
+    crFillS(k, n, out, count, 2.f/16777216.f, -1.f);
+}
+
+void crFillRuv(const crkey k, uint32_t n, float* xyz, const unsigned int count)
+{
+    // two counters per vector, the same as crRuvBT() walking a stream
+    float u[128];
+    for(unsigned int i = 0; i < count;)
+    {
+        const unsigned int m = count-i < 64 ? count-i : 64;
+        crFill(k, n, u, m*2);
+        n += m*2;
+        for(unsigned int j = 0; j < m; j++, i++)
+        {
+            const float y = simacosf(u[j*2]*2.f - 1.f) - d2PI;
+            const float p = x2PI * u[j*2+1];
+            xyz[i*3]   = simcosf(y) * simcosf(p);
+            xyz[i*3+1] = simcosf(y) * simsinf(p);
+            xyz[i*3+2] = simsinf(y);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+    View frustum and planet occlusion culling.
+
+    clSetup() takes the six frustum planes out of the clip
+    matrix, projection times view (Gribb & Hartmann), and
+    the shadow of the occluder sphere at the origin as seen
+    from the eye. clVisible() then says if a bounding
+    sphere can be seen at all; no, when it is wholly
+    outside one plane, or wholly inside the cone the
+    occluder casts and further away than the circle where
+    the cone touches it, the ball is in the way of every
+    ray to it there. Both tests are conservative, a sphere
+    that might show is always kept.
+
+    The occluder has to be solid whatever happens to the
+    planet, pass a radius inside the part craters can not
+    dig into.
+
+    Requires:
+        - vec.h
+        - mat.h
+*/
+
+#ifndef CULL_H
+#define CULL_H
+
+#include <math.h>
+#include "vec.h"
+#include "mat.h"
+
+enum
+{
+    CL_VISIBLE,
+    CL_FRUSTUM, // outside the frustum
+    CL_PLANET   // behind the occluder
+};
+
+typedef struct
+{
+    float p[6][4];      // planes, inside when ax+by+cz+d >= 0
+    vec eye;
+    vec axis;           // eye to occluder centre, unit
+    float sin, cos;     // occluder cone half angle
+    float plane;        // eye to silhouette circle along axis
+    int occludes;       // 0 with the eye inside the occluder
+} clview;
+
+void clSetup(clview* c, const mat* clip, const vec eye, const float occluder);
+static inline int clVisible(const clview* c, const vec p, const float r);
+
+//
+
+void clSetup(clview* c, const mat* clip, const vec eye, const float occluder)
+{
+    // rows of the column major clip matrix, w +/- x, y, z
+    for(int i = 0; i < 3; i++)
+    {
+        for(int k = 0; k < 4; k++)
+        {
+            c->p[i*2][k]   = clip->m[k][3] + clip->m[k][i];
+            c->p[i*2+1][k] = clip->m[k][3] - clip->m[k][i];
+        }
+    }
+    for(int i = 0; i < 6; i++)
+    {
+        const float l = sqrtf(c->p[i][0]*c->p[i][0] + c->p[i][1]*c->p[i][1] + c->p[i][2]*c->p[i][2]);
+        if(l == 0.f){continue;}
+        const float rl = 1.f / l;
+        for(int k = 0; k < 4; k++)
+            c->p[i][k] *= rl;
+    }
+
+    c->eye = eye;
+    const float d = vMod(eye);
+    c->occludes = d > occluder;
+    if(c->occludes == 0){return;}
+    c->axis = (vec){-eye.x / d, -eye.y / d, -eye.z / d};
+    c->sin = occluder / d;
+    c->cos = sqrtf(1.f - c->sin*c->sin);
+    c->plane = d - occluder * c->sin;
+}
+
+// CL_VISIBLE if any of the sphere at p of radius r may be seen
+static inline int clVisible(const clview* c, const vec p, const float r)
+{
+    for(int i = 0; i < 6; i++)
+        if(c->p[i][0]*p.x + c->p[i][1]*p.y + c->p[i][2]*p.z + c->p[i][3] < -r)
+            return CL_FRUSTUM;
+
+    if(c->occludes == 0){return CL_VISIBLE;}
+    const vec v = (vec){p.x - c->eye.x, p.y - c->eye.y, p.z - c->eye.z};
+    const float along = vDot(v, c->axis);
+    if(along - r < c->plane){return CL_VISIBLE;}
+    const vec o = (vec){v.x - c->axis.x*along, v.y - c->axis.y*along, v.z - c->axis.z*along};
+    if(along*c->sin - vMod(o)*c->cos < r){return CL_VISIBLE;}
+    return CL_PLANET;
+}
+
+#endif
@@ -61,6 +61,7 @@ GLuint esRand(const GLuint min, const GLuint max);
 GLfloat esRandFloat(const GLfloat min, const GLfloat max);
 void esBind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage);
 void esRebind(const GLenum target, GLuint* buffer, const void* data, const GLsizeiptr datalen, const GLenum usage);
+void esRebindRange(const GLenum target, GLuint* buffer, const GLintptr offset, const void* data, const GLsizeiptr datalen);
 void esBindModel(ESModel* model, const GLfloat* vertices, const GLsizei vertlen, const GLushort* indices, const GLsizei indlen);
 GLuint esLoadTexture(const GLuint w, const GLuint h, const unsigned char* data);
 GLuint esLoadTextureA(const GLuint w, const GLuint h, const unsigned char* data);
@@ -76,6 +77,8 @@ void makeLambert();
 void makeLambert1();
 void makeLambert2();
 void makeLambert3();
+void makeLambert2C();
+void makeLambert3I();
 void makePhong();
 void makePhong1();
 void makePhong2();
@@ -88,6 +91,8 @@ void shadeLambert(GLint* position, GLint* projection, GLint* modelview, GLint* l
 void shadeLambert1(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity);   // solid color + normals
 void shadeLambert2(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* color, GLint* opacity);                  // colors + no normals
 void shadeLambert3(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity);   // colors + normals
+void shadeLambert2C(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* color, GLint* opacity, GLint* impacts, GLint* numimpacts); // colors + no normals + craters
+void shadeLambert3I(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* inst0, GLint* inst1);  // colors + normals + per instance transform
 
 void shadePhong(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* color, GLint* opacity);                   // solid color + no normals
 void shadePhong1(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* normal, GLint* color, GLint* opacity);   // solid color + normals
@@ -122,6 +127,13 @@ void esRebind(const GLenum target, GLuint* buffer, const void* data, const GLsiz
     glBufferData(target, datalen, data, usage);
 }
 
+void esRebindRange(const GLenum target, GLuint* buffer, const GLintptr offset, const void* data, const GLsizeiptr datalen)
+{
+    // data points at the start of the whole array, only [offset, offset+datalen) is sent
+    glBindBuffer(target, *buffer);
+    glBufferSubData(target, offset, datalen, (const unsigned char*)data + offset);
+}
+
 void esBindModel(ESModel* model, const GLfloat* vertices, const GLsizei vertlen, const GLushort* indices, const GLsizei indlen)
 {
     esBind(GL_ARRAY_BUFFER, &model->vid, vertices, vertlen * sizeof(GLfloat) * 3, GL_STATIC_DRAW);
@@ -330,6 +342,87 @@ const GLchar* v13 =
         "gl_Position = projection * modelview * position;\n"
     "}\n";
 
+// color array + no normals + crater list
+// each impact is a vec4 of crater center and radius, applied in
+// order; vertices inside a crater sink to its rim and darken
+#define ES_MAX_IMPACTS 96 // keep in step with MAX_IMPACTS below
+const GLchar* v14 =
+    "#version 100\n"
+    "#define MAX_IMPACTS 96\n"
+    "uniform mat4 modelview;\n"
+    "uniform mat4 projection;\n"
+    "uniform float opacity;\n"
+    "uniform vec3 lightpos;\n"
+    "uniform vec4 impacts[MAX_IMPACTS];\n"
+    "uniform int numimpacts;\n"
+    "attribute vec4 position;\n"
+    "attribute vec3 color;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertNorm;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "vec3 p = position.xyz;\n"
+        "vec3 c = color;\n"
+        "for(int i = 0; i < MAX_IMPACTS; i++)\n"
+        "{\n"
+            "if(i >= numimpacts){break;}\n"
+            "float d = distance(p, impacts[i].xyz);\n"
+            "if(d < impacts[i].w)\n"
+            "{\n"
+                "p -= normalize(p) * (impacts[i].w - d);\n"
+                "c -= 0.2;\n"
+            "}\n"
+        "}\n"
+        "vec4 pos = vec4(p, 1.0);\n"
+        "vec4 vertPos4 = modelview * pos;\n"
+        "vertPos = vec3(vertPos4) / vertPos4.w;\n"
+        "vertNorm = vec3(modelview * vec4(normalize(p), 0.0));\n"
+        "vertCol = c;\n"
+        "vertOpa = opacity;\n"
+        "vlightPos = vec4(modelview * vec4(lightpos, 1.0)).xyz;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
+// color array + normal array + per instance model
+// inst0 is the position and scale, inst1 the rotation angle,
+// which rotations apply (the comet rot value) and the opacity;
+// the same translate, rotate, scale order main.c builds with mat.h
+const GLchar* v15 =
+    "#version 100\n"
+    "uniform mat4 modelview;\n" // the view, the model comes per instance
+    "uniform mat4 projection;\n"
+    "uniform vec3 lightpos;\n"
+    "attribute vec4 position;\n"
+    "attribute vec3 normal;\n"
+    "attribute vec3 color;\n"
+    "attribute vec4 inst0;\n"
+    "attribute vec4 inst1;\n"
+    "varying vec3 vertPos;\n"
+    "varying vec3 vertNorm;\n"
+    "varying vec3 vertCol;\n"
+    "varying float vertOpa;\n"
+    "varying vec3 vlightPos;\n"
+    "void main()\n"
+    "{\n"
+        "float s = sin(inst1.x);\n"
+        "float c = cos(inst1.x);\n"
+        "mat3 r = mat3(1.0);\n"
+        "if(inst1.y < 100.0){r = mat3(1.0, 0.0, 0.0, 0.0, c, -s, 0.0, s, c);}\n"     // mRotY
+        "if(inst1.y < 200.0){r = r * mat3(c, -s, 0.0, s, c, 0.0, 0.0, 0.0, 1.0);}\n" // mRotZ
+        "if(inst1.y < 300.0){r = r * mat3(c, 0.0, s, 0.0, 1.0, 0.0, -s, 0.0, c);}\n" // mRotX
+        "vec4 p = vec4(r * (position.xyz * inst0.w) + inst0.xyz, 1.0);\n"
+        "vec4 vertPos4 = modelview * p;\n"
+        "vertPos = vec3(vertPos4) / vertPos4.w;\n"
+        "vertNorm = vec3(modelview * vec4(r * normal, 0.0));\n"
+        "vertCol = color;\n"
+        "vertOpa = inst1.z;\n"
+        "vlightPos = lightpos;\n"
+        "gl_Position = projection * vertPos4;\n"
+    "}\n";
+
 const GLchar* f1 =
     "#version 100\n"
     "precision mediump float;\n"
@@ -547,6 +640,24 @@ GLint  shdLambert3_lightpos;
 GLint  shdLambert3_color;
 GLint  shdLambert3_normal;
 GLint  shdLambert3_opacity;
+GLuint shdLambert2C;
+GLint  shdLambert2C_position;
+GLint  shdLambert2C_projection;
+GLint  shdLambert2C_modelview;
+GLint  shdLambert2C_lightpos;
+GLint  shdLambert2C_color;
+GLint  shdLambert2C_opacity;
+GLint  shdLambert2C_impacts;
+GLint  shdLambert2C_numimpacts;
+GLuint shdLambert3I;
+GLint  shdLambert3I_position;
+GLint  shdLambert3I_projection;
+GLint  shdLambert3I_modelview;
+GLint  shdLambert3I_lightpos;
+GLint  shdLambert3I_color;
+GLint  shdLambert3I_normal;
+GLint  shdLambert3I_inst0;
+GLint  shdLambert3I_inst1;
 GLuint shdPhong;
 GLint  shdPhong_position;
 GLint  shdPhong_projection;
@@ -703,6 +814,32 @@ void makeLambert2()
     shdLambert2_opacity = glGetUniformLocation(shdLambert2, "opacity");
 }
 
+void makeLambert2C()
+{
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &v14, NULL);
+    glCompileShader(vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &f1, NULL);
+    glCompileShader(fragmentShader);
+
+    shdLambert2C = glCreateProgram();
+        glAttachShader(shdLambert2C, vertexShader);
+        glAttachShader(shdLambert2C, fragmentShader);
+    glLinkProgram(shdLambert2C);
+
+    shdLambert2C_position = glGetAttribLocation(shdLambert2C, "position");
+    shdLambert2C_color = glGetAttribLocation(shdLambert2C, "color");
+    
+    shdLambert2C_projection = glGetUniformLocation(shdLambert2C, "projection");
+    shdLambert2C_modelview = glGetUniformLocation(shdLambert2C, "modelview");
+    shdLambert2C_lightpos = glGetUniformLocation(shdLambert2C, "lightpos");
+    shdLambert2C_opacity = glGetUniformLocation(shdLambert2C, "opacity");
+    shdLambert2C_impacts = glGetUniformLocation(shdLambert2C, "impacts");
+    shdLambert2C_numimpacts = glGetUniformLocation(shdLambert2C, "numimpacts");
+}
+
 void makeLambert3()
 {
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -728,6 +865,32 @@ void makeLambert3()
     shdLambert3_opacity = glGetUniformLocation(shdLambert3, "opacity");
 }
 
+void makeLambert3I()
+{
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &v15, NULL);
+    glCompileShader(vertexShader);
+
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &f1, NULL);
+    glCompileShader(fragmentShader);
+
+    shdLambert3I = glCreateProgram();
+        glAttachShader(shdLambert3I, vertexShader);
+        glAttachShader(shdLambert3I, fragmentShader);
+    glLinkProgram(shdLambert3I);
+
+    shdLambert3I_position = glGetAttribLocation(shdLambert3I, "position");
+    shdLambert3I_normal = glGetAttribLocation(shdLambert3I, "normal");
+    shdLambert3I_color = glGetAttribLocation(shdLambert3I, "color");
+    shdLambert3I_inst0 = glGetAttribLocation(shdLambert3I, "inst0");
+    shdLambert3I_inst1 = glGetAttribLocation(shdLambert3I, "inst1");
+    
+    shdLambert3I_projection = glGetUniformLocation(shdLambert3I, "projection");
+    shdLambert3I_modelview = glGetUniformLocation(shdLambert3I, "modelview");
+    shdLambert3I_lightpos = glGetUniformLocation(shdLambert3I, "lightpos");
+}
+
 void makePhong()
 {
     GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -838,6 +1001,8 @@ void makeAllShaders()
     makeLambert1();
     makeLambert2();
     makeLambert3();
+    makeLambert2C();
+    makeLambert3I();
     makePhong();
     makePhong1();
     makePhong2();
@@ -910,6 +1075,32 @@ void shadeLambert2(GLint* position, GLint* projection, GLint* modelview, GLint*
     glUseProgram(shdLambert2);
 }
 
+void shadeLambert2C(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* color, GLint* opacity, GLint* impacts, GLint* numimpacts)
+{
+    *position = shdLambert2C_position;
+    *projection = shdLambert2C_projection;
+    *modelview = shdLambert2C_modelview;
+    *lightpos = shdLambert2C_lightpos;
+    *color = shdLambert2C_color;
+    *opacity = shdLambert2C_opacity;
+    *impacts = shdLambert2C_impacts;
+    *numimpacts = shdLambert2C_numimpacts;
+    glUseProgram(shdLambert2C);
+}
+
+void shadeLambert3I(GLint* position, GLint* projection, GLint* modelview, GLint* lightpos, GLint* normal, GLint* color, GLint* inst0, GLint* inst1)
+{
+    *position = shdLambert3I_position;
+    *projection = shdLambert3I_projection;
+    *modelview = shdLambert3I_modelview;
+    *lightpos = shdLambert3I_lightpos;
+    *color = shdLambert3I_color;
+    *normal = shdLambert3I_normal;
+    *inst0 = shdLambert3I_inst0;
+    *inst1 = shdLambert3I_inst1;
+    glUseProgram(shdLambert3I);
+}
+
 void shadePhong(GLint* position, GLint* projection, GLint* modelview, GLint* normalmat, GLint* lightpos, GLint* color, GLint* opacity)
 {
     *position = shdPhong_position;
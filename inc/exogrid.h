@@ -0,0 +1,323 @@
+/*
+    Lat/long bucket index over the exo vertices.
+
+    Impacts only ever push a vertex along its own
+    direction from the origin, so the bucket a vertex
+    lands in at startup stays valid for the rest of the
+    game. The only exception is a vertex pushed through
+    the origin by a deep crater; it flips to the other
+    side of the planet and is moved to a small spill
+    list that every query scans.
+
+    A query for a crater of radius f at p only has to
+    visit the buckets inside the cone of half angle
+    asin(f/|p|) around p, every vertex outside of that
+    cone is further than f from p at any radius, and
+    egBound() sums the same buckets to cap the damage such
+    a crater can do without touching a vertex.
+
+    The grid also keeps the exo half of the simulation
+    hash, every vertex a crater moves swaps its term.
+
+    Requires:
+        - vec.h
+        - simhash.h
+*/
+
+#ifndef EXOGRID_H
+#define EXOGRID_H
+
+#include <stdlib.h>
+#include "vec.h"
+#include "simhash.h"
+
+typedef struct
+{
+    unsigned int rows, cols;
+    float rrow, rcol;       // cells per radian
+    unsigned int* start;    // first slot of each bucket (rows*cols)
+    unsigned int* count;    // live vertices in each bucket
+    unsigned int* idx;      // vertex indices ordered by bucket
+    unsigned int* slot;     // slot of each vertex in idx
+    unsigned int* spill;    // vertices that crossed the origin
+    unsigned int* idx0;     // idx and count as built, for egReset()
+    unsigned int* count0;
+    unsigned int nspill;
+    unsigned int dirty0;    // first vertex moved since egClean()
+    unsigned int dirty1;    // one past the last vertex moved
+    uint64_t hash;          // sum of shVertex() over every vertex
+} exogrid;
+
+int   egBuild(exogrid* g, const float* v, const size_t numvert);
+void  egFree(exogrid* g);
+static inline void egClean(exogrid* g);
+unsigned int egImpact(exogrid* g, float* v, float* c, const vec p, const float f);
+unsigned int egBound(const exogrid* g, const vec p, const float f);
+void  egReset(exogrid* g, const size_t numvert);
+void  egSync(exogrid* g, const float* v, const float* base, const size_t numvert);
+
+//
+
+static inline unsigned int egRow(const exogrid* g, const float lat)
+{
+    const int r = (int)((lat + d2PI) * g->rrow);
+    if(r < 0){return 0;}
+    if(r >= (int)g->rows){return g->rows-1;}
+    return r;
+}
+
+static inline unsigned int egCol(const exogrid* g, const float lon)
+{
+    const int c = (int)((lon + PI) * g->rcol);
+    if(c < 0){return 0;}
+    if(c >= (int)g->cols){return g->cols-1;}
+    return c;
+}
+
+static inline unsigned int egCell(const exogrid* g, const float x, const float y, const float z)
+{
+    const float l = sqrtf(x*x + y*y + z*z);
+    float s = l > 0.f ? z / l : 0.f;
+    if(s > 1.f){s = 1.f;}
+    else if(s < -1.f){s = -1.f;}
+    return egRow(g, asinf(s)) * g->cols + egCol(g, atan2f(y, x));
+}
+
+int egBuild(exogrid* g, const float* v, const size_t numvert)
+{
+    // aim for roughly 12 vertices per bucket
+    unsigned int cols = (unsigned int)sqrtf((float)numvert / 6.f);
+    if(cols < 8){cols = 8;}
+    g->cols = cols;
+    g->rows = cols / 2;
+    g->rcol = (float)g->cols / x2PI;
+    g->rrow = (float)g->rows / PI;
+    g->nspill = 0;
+    egClean(g);
+
+    const unsigned int nc = g->rows * g->cols;
+    g->start = calloc(nc+1, sizeof(unsigned int));
+    g->count = calloc(nc, sizeof(unsigned int));
+    g->idx   = malloc(numvert * sizeof(unsigned int));
+    g->slot  = malloc(numvert * sizeof(unsigned int));
+    g->spill = malloc(numvert * sizeof(unsigned int));
+    g->idx0  = malloc(numvert * sizeof(unsigned int));
+    g->count0 = malloc(nc * sizeof(unsigned int));
+    if(g->start == NULL || g->count == NULL || g->idx == NULL || g->slot == NULL || g->spill == NULL || g->idx0 == NULL || g->count0 == NULL)
+    {
+        egFree(g);
+        return -1;
+    }
+
+    // counting sort of the vertices into their buckets
+    g->hash = 0;
+    for(size_t i = 0; i < numvert; i++)
+    {
+        const float* p = &v[i*3];
+        g->hash += shVertex(i, p[0], p[1], p[2]);
+        g->slot[i] = egCell(g, p[0], p[1], p[2]);
+        g->count[g->slot[i]]++;
+    }
+    for(unsigned int i = 0; i < nc; i++)
+        g->start[i+1] = g->start[i] + g->count[i];
+    memset(g->count, 0, nc * sizeof(unsigned int));
+    for(size_t i = 0; i < numvert; i++)
+    {
+        const unsigned int b = g->slot[i];
+        const unsigned int s = g->start[b] + g->count[b]++;
+        g->idx[s] = i;
+        g->slot[i] = s;
+    }
+    memcpy(g->idx0, g->idx, numvert * sizeof(unsigned int));
+    memcpy(g->count0, g->count, nc * sizeof(unsigned int));
+    return 0;
+}
+
+void egFree(exogrid* g)
+{
+    free(g->start);
+    free(g->count);
+    free(g->idx);
+    free(g->slot);
+    free(g->spill);
+    free(g->idx0);
+    free(g->count0);
+    memset(g, 0, sizeof(exogrid));
+}
+
+// reset the dirty vertex range once it has been uploaded
+static inline void egClean(exogrid* g)
+{
+    g->dirty0 = 0xFFFFFFFF;
+    g->dirty1 = 0;
+}
+
+static inline void egDirty(exogrid* g, const unsigned int i)
+{
+    if(i < g->dirty0){g->dirty0 = i;}
+    if(i >= g->dirty1){g->dirty1 = i+1;}
+}
+
+// vertex i moved from o
+static inline void egMoved(exogrid* g, const float* v, const unsigned int i, const vec o)
+{
+    egDirty(g, i);
+    g->hash += shVertex(i, v[i*3], v[i*3+1], v[i*3+2]) - shVertex(i, o.x, o.y, o.z);
+}
+
+// move a vertex that crossed the origin out of its bucket
+static inline void egSpill(exogrid* g, const unsigned int b, const unsigned int i)
+{
+    const unsigned int last = g->start[b] + --g->count[b];
+    const unsigned int s = g->slot[i];
+    g->idx[s] = g->idx[last];
+    g->slot[g->idx[s]] = s;
+    g->spill[g->nspill++] = i;
+}
+
+// the crater itself, identical to the original per vertex scan
+static inline unsigned int egCrater(float* v, float* c, const unsigned int i, const vec p, const float f)
+{
+    const unsigned int j = i*3;
+    vec n = {v[j], v[j+1], v[j+2]};
+    float ds = vDistSq(n, p);
+    if(ds < f*f)
+    {
+        ds = vDist(n, p);
+        vNorm(&n);
+        const float sr = f-ds;
+        vMulS(&n, n, sr);
+        v[j]   -= n.x;
+        v[j+1] -= n.y;
+        v[j+2] -= n.z;
+        c[j]   -= 0.2f;
+        c[j+1] -= 0.2f;
+        c[j+2] -= 0.2f;
+        return sr > 0.03f ? 2 : 1;
+    }
+    return 0;
+}
+
+// the bucket rows r0..r1 and the nc columns from c0 on, wrapping, that hold
+// every direction that can reach a crater of radius f at p
+static inline void egCone(const exogrid* g, const vec p, const float f, unsigned int* r0o, unsigned int* r1o, unsigned int* c0o, unsigned int* nco)
+{
+    const float pm = vMod(p);
+    unsigned int r0 = 0, r1 = g->rows-1;
+    unsigned int c0 = 0, nc = g->cols;
+    if(pm > f)
+    {
+        const float a = asinf(f / pm);
+        const float lat = asinf(p.z / pm);
+        const float lon = atan2f(p.y, p.x);
+        const float rcell = 1.f / g->rrow;
+        const float ccell = 1.f / g->rcol;
+        const int pole = lat + a + rcell >= d2PI || lat - a - rcell <= -d2PI;
+        r0 = egRow(g, lat - a - rcell);
+        r1 = egRow(g, lat + a + rcell);
+        if(pole == 0)
+        {
+            const float dlon = asinf(sinf(a) / cosf(lat)) + ccell;
+            if(dlon < PI)
+            {
+                c0 = egCol(g, lon - dlon);
+                if(lon - dlon < -PI){c0 = egCol(g, lon - dlon + x2PI);}
+                nc = (unsigned int)(2.f * dlon * g->rcol) + 2;
+                if(nc > g->cols){nc = g->cols;}
+            }
+        }
+    }
+    *r0o = r0; *r1o = r1; *c0o = c0; *nco = nc;
+}
+
+// returns the damage dealt by a crater of radius f at p
+unsigned int egImpact(exogrid* g, float* v, float* c, const vec p, const float f)
+{
+    unsigned int damage = 0;
+
+    // spilled vertices are always candidates
+    for(unsigned int k = 0; k < g->nspill; k++)
+    {
+        const unsigned int i = g->spill[k];
+        const vec o = {v[i*3], v[i*3+1], v[i*3+2]};
+        const unsigned int h = egCrater(v, c, i, p, f);
+        if(h != 0){egMoved(g, v, i, o);}
+        if(h == 2){damage++;}
+    }
+
+    // cone of directions that can reach the crater
+    unsigned int r0, r1, c0, nc;
+    egCone(g, p, f, &r0, &r1, &c0, &nc);
+    for(unsigned int r = r0; r <= r1; r++)
+    {
+        for(unsigned int k = 0; k < nc; k++)
+        {
+            unsigned int col = c0 + k;
+            if(col >= g->cols){col -= g->cols;}
+            const unsigned int b = r * g->cols + col;
+            for(unsigned int s = g->start[b]; s < g->start[b] + g->count[b];)
+            {
+                const unsigned int i = g->idx[s];
+                const unsigned int j = i*3;
+                const vec o = {v[j], v[j+1], v[j+2]};
+                const unsigned int h = egCrater(v, c, i, p, f);
+                if(h != 0){egMoved(g, v, i, o);}
+                if(h == 2){damage++;}
+                if(h != 0 && o.x*v[j] + o.y*v[j+1] + o.z*v[j+2] <= 0.f)
+                {
+                    egSpill(g, b, i);
+                    continue; // slot s now holds the bucket's last vertex
+                }
+                s++;
+            }
+        }
+    }
+    return damage;
+}
+
+// the most damage egImpact() could do now, every vertex it would look at
+unsigned int egBound(const exogrid* g, const vec p, const float f)
+{
+    unsigned int r0, r1, c0, nc;
+    egCone(g, p, f, &r0, &r1, &c0, &nc);
+    unsigned int n = g->nspill;
+    for(unsigned int r = r0; r <= r1; r++)
+    {
+        for(unsigned int k = 0; k < nc; k++)
+        {
+            unsigned int col = c0 + k;
+            if(col >= g->cols){col -= g->cols;}
+            n += g->count[r * g->cols + col];
+        }
+    }
+    return n;
+}
+
+// back to the buckets as built, no vertex spilled
+void egReset(exogrid* g, const size_t numvert)
+{
+    memcpy(g->idx, g->idx0, numvert * sizeof(unsigned int));
+    memcpy(g->count, g->count0, g->rows * g->cols * sizeof(unsigned int));
+    for(size_t s = 0; s < numvert; s++)
+        g->slot[g->idx[s]] = s;
+    g->nspill = 0;
+}
+
+// the vertices were replaced wholesale on a grid reset to base, spill
+// every vertex now on the far side of the origin and rehash
+void egSync(exogrid* g, const float* v, const float* base, const size_t numvert)
+{
+    g->hash = 0;
+    for(size_t i = 0; i < numvert; i++)
+    {
+        const float* p = &v[i*3];
+        const float* o = &base[i*3];
+        g->hash += shVertex(i, p[0], p[1], p[2]);
+        if(p[0]*o[0] + p[1]*o[1] + p[2]*o[2] <= 0.f)
+            egSpill(g, egCell(g, o[0], o[1], o[2]), i);
+    }
+    g->dirty0 = 0;
+    g->dirty1 = numvert;
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+    Per phase frame timing.
+
+    The frame is cut into consecutive phases, ftMark(phase)
+    charges the time since the previous mark to phase and
+    ftFrame() closes the frame into a ring of the last
+    FT_FRAMES frames. A phase can be marked any number of
+    times a frame, every slice adds up. The ring has one
+    writer, the render thread, and the published count is
+    atomic so ftDump() can read it from anywhere without a
+    lock; a dump races at most the one frame being written
+    and skips it.
+
+    ftDump() prints p50, p95, p99 and the worst frame per
+    phase in microseconds over the frames in the ring, the
+    hitches the average fps hides. FT_NOTIME compiles every
+    mark away.
+
+    ftCount(counter, n) adds to a per frame counter kept in
+    the same ring, things like how many draws the culling
+    let through, and ftDump() gives them the same columns.
+
+    Requires:
+        - (nothing)
+*/
+
+#ifndef FTIME_H
+#define FTIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+enum
+{
+    FT_INPUT,   // glfwPollEvents()
+    FT_SIM,     // simulation ticks and catch up
+    FT_EXO,     // crater pass in the ticks
+    FT_CAMERA,
+    FT_PATCH,   // exo patch bounds the new craters moved
+    FT_UPLOAD,  // exo buffer upload
+    FT_DRAW,    // draw submission
+    FT_SWAP,    // glfwSwapBuffers()
+    FT_SLEEP,   // fps limiter
+    FT_PHASES
+};
+
+enum
+{
+    FTC_SUBMITTED,      // comets and players drawn
+    FTC_CULL_FRUSTUM,   // outside the view
+    FTC_CULL_PLANET,    // behind the planet
+    FTC_EXO_TRIS,       // exo and inner shell triangles sent
+    FT_COUNTERS
+};
+
+#define FT_FRAMES 4096 // power of two
+
+typedef struct
+{
+    float us[FT_PHASES];
+    float n[FT_COUNTERS];
+} ftframe;
+
+ftframe ft_ring[FT_FRAMES];
+uint64_t ft_count = 0; // frames published
+ftframe ft_cur;
+uint64_t ft_last = 0;
+
+static const char* ft_names[FT_PHASES] = {"input", "sim", "exo", "camera", "patch", "upload", "draw", "swap", "sleep"};
+static const char* ft_cnames[FT_COUNTERS] = {"drawn", "frustum", "planet", "exo tris"};
+
+static inline void ftMark(const unsigned int phase);
+static inline void ftCount(const unsigned int counter, const unsigned int n);
+static inline void ftFrame();
+void ftDump();
+
+//
+
+static inline uint64_t ftNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+static inline void ftMark(const unsigned int phase)
+{
+#ifndef FT_NOTIME
+    const uint64_t t = ftNow();
+    if(ft_last != 0){ft_cur.us[phase] += (float)(t - ft_last) * 0.001f;}
+    ft_last = t;
+#endif
+}
+
+static inline void ftCount(const unsigned int counter, const unsigned int n)
+{
+#ifndef FT_NOTIME
+    ft_cur.n[counter] += (float)n;
+#endif
+}
+
+static inline void ftFrame()
+{
+#ifndef FT_NOTIME
+    const uint64_t n = __atomic_load_n(&ft_count, __ATOMIC_RELAXED);
+    ft_ring[n & (FT_FRAMES-1)] = ft_cur;
+    __atomic_store_n(&ft_count, n+1, __ATOMIC_RELEASE);
+    for(unsigned int i = 0; i < FT_PHASES; i++)
+        ft_cur.us[i] = 0.f;
+    for(unsigned int i = 0; i < FT_COUNTERS; i++)
+        ft_cur.n[i] = 0.f;
+#endif
+}
+
+int ftCmp(const void* a, const void* b)
+{
+    const float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+void ftDump()
+{
+    const uint64_t n = __atomic_load_n(&ft_count, __ATOMIC_ACQUIRE);
+    // the oldest slot may be mid write, leave it out
+    const unsigned int nf = n < FT_FRAMES ? (unsigned int)n : FT_FRAMES-1;
+    if(nf == 0){return;}
+    float* s = malloc(nf * sizeof(float));
+    float* tot = malloc(nf * sizeof(float));
+    if(s == NULL || tot == NULL){free(s); free(tot); return;}
+
+    printf("frame timing over the last %u frames, microseconds\n", nf);
+    printf("%-8s %9s %9s %9s %9s %9s\n", "phase", "mean", "p50", "p95", "p99", "max");
+    for(unsigned int i = 0; i < nf; i++)
+        tot[i] = 0.f;
+    for(unsigned int p = 0; p <= FT_PHASES; p++)
+    {
+        double mean = 0.0;
+        if(p < FT_PHASES)
+        {
+            for(unsigned int i = 0; i < nf; i++)
+            {
+                s[i] = ft_ring[(n-1-i) & (FT_FRAMES-1)].us[p];
+                tot[i] += s[i];
+                mean += s[i];
+            }
+        }
+        else
+        {
+            for(unsigned int i = 0; i < nf; i++)
+            {
+                s[i] = tot[i];
+                mean += s[i];
+            }
+        }
+        qsort(s, nf, sizeof(float), ftCmp);
+        printf("%-8s %9.1f %9.1f %9.1f %9.1f %9.1f\n", p < FT_PHASES ? ft_names[p] : "frame", mean / nf,
+            s[nf/2], s[(nf*95)/100], s[(nf*99)/100], s[nf-1]);
+    }
+    printf("counts per frame\n");
+    for(unsigned int c = 0; c < FT_COUNTERS; c++)
+    {
+        double mean = 0.0;
+        for(unsigned int i = 0; i < nf; i++)
+        {
+            s[i] = ft_ring[(n-1-i) & (FT_FRAMES-1)].n[c];
+            mean += s[i];
+        }
+        qsort(s, nf, sizeof(float), ftCmp);
+        printf("%-8s %9.1f %9.0f %9.0f %9.0f %9.0f\n", ft_cnames[c], mean / nf,
+            s[nf/2], s[(nf*95)/100], s[(nf*99)/100], s[nf-1]);
+    }
+    free(s);
+    free(tot);
+}
+
+#endif
@@ -0,0 +1,191 @@
+/*
+    GL vertex state cache.
+
+    A gsarray is the vertex state of one thing that gets
+    drawn; which buffer feeds each attribute and the index
+    buffer. With GL 3.0 every gsarray is a vertex array
+    object and binding it is one call, without it every
+    gsarray shares the one default state and the calls go
+    through a filter that drops any that would set what is
+    already set. Either way the render path says what it
+    wants every draw and only the difference reaches the
+    driver, no more hand kept bound flags.
+
+    The cache tracks attribute pointers, enables, divisors
+    and the index buffer as the bound array holds them, so
+    after gsInit() every call that touches those has to go
+    through here; GL_ARRAY_BUFFER itself is not tracked and
+    anything may bind it. GSCALL() counts any other gl call
+    made in the frame and GSCALLS() a helper that makes n
+    of them. A call the filter skips counts as dropped, one
+    for each gl call it would have made. gsFrame() closes
+    the frame and gsDump() prints the calls per frame made
+    and dropped.
+
+    Requires:
+        - gl.h
+        - esAux2.h
+*/
+
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#define GS_ATTRIBS 16
+
+typedef struct
+{
+    GLuint buffer;
+    GLint size;
+    GLsizei stride;
+    size_t offset;
+    GLuint divisor;
+    unsigned char enabled;
+} gsattr;
+
+typedef struct
+{
+    GLuint vao; // 0 until first bound, or always without VAOs
+    GLuint iid;
+    gsattr a[GS_ATTRIBS];
+} gsarray;
+
+unsigned int gs_vaos = 0;           // 1 if gsarrays are VAOs
+gsarray gs_default;                 // the state without VAOs
+gsarray* gs_bound = &gs_default;
+unsigned char gs_blend = 0;
+
+unsigned int gs_calls = 0, gs_dropped = 0;  // this frame
+unsigned int gs_max = 0;
+unsigned long gs_frames = 0, gs_total = 0, gs_total_dropped = 0;
+
+// counts a gl call the cache does not issue itself, or n of them
+#define GSCALL(x) do{gs_calls++; x;}while(0)
+#define GSCALLS(n, x) do{gs_calls += (n); x;}while(0)
+
+void gsInit();
+void gsBind(gsarray* a);
+void gsAttrib(const GLint index, const GLuint buffer, const GLint size, const GLsizei stride, const size_t offset, const GLuint divisor);
+void gsIndices(const GLuint iid);
+void gsModel(gsarray* a, const ESModel* m, const GLint position, const GLint normal, const GLint color);
+void gsBlend(const unsigned char on);
+void gsFrame();
+void gsDump();
+
+//
+
+// after gladLoadGL() and once every buffer is made
+void gsInit()
+{
+    gs_vaos = GLAD_GL_VERSION_3_0 ? 1 : 0;
+    memset(&gs_default, 0, sizeof(gsarray));
+    gs_default.iid = (GLuint)-1; // unknown, bind it on first use
+    gs_bound = &gs_default;
+    gs_blend = glIsEnabled(GL_BLEND);
+}
+
+void gsBind(gsarray* a)
+{
+    if(gs_vaos == 0){gs_bound = &gs_default; return;}
+    if(a->vao == 0)
+    {
+        glGenVertexArrays(1, &a->vao);
+        a->iid = 0;
+        gs_calls++;
+    }
+    if(gs_bound == a){gs_dropped++; return;}
+    glBindVertexArray(a->vao);
+    gs_bound = a;
+    gs_calls++;
+}
+
+// float attributes only, offset in bytes from the start of buffer
+void gsAttrib(const GLint index, const GLuint buffer, const GLint size, const GLsizei stride, const size_t offset, const GLuint divisor)
+{
+    if(index < 0 || index >= GS_ATTRIBS){return;}
+    gsattr* s = &gs_bound->a[index];
+    if(s->enabled == 1 && s->buffer == buffer && s->size == size && s->stride == stride && s->offset == offset)
+    {
+        gs_dropped += 2; // the bind and the pointer
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        s->buffer = buffer;
+        s->size = size;
+        s->stride = stride;
+        s->offset = offset;
+        gs_calls += 2;
+    }
+    if(s->enabled == 0)
+    {
+        glEnableVertexAttribArray(index);
+        s->enabled = 1;
+        gs_calls++;
+    }
+    else
+        gs_dropped++;
+
+    // a divisor of 0 is the default, only an instanced attribute would have set it
+    if(s->divisor != divisor)
+    {
+        glVertexAttribDivisor(index, divisor);
+        s->divisor = divisor;
+        gs_calls++;
+    }
+    else if(divisor != 0)
+        gs_dropped++;
+}
+
+void gsIndices(const GLuint iid)
+{
+    if(gs_bound->iid == iid){gs_dropped++; return;}
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iid);
+    gs_bound->iid = iid;
+    gs_calls++;
+}
+
+// binds a and points it at the buffers of m, -1 for the attributes not used
+void gsModel(gsarray* a, const ESModel* m, const GLint position, const GLint normal, const GLint color)
+{
+    gsBind(a);
+    gsAttrib(position, m->vid, 3, 0, 0, 0);
+    gsAttrib(normal, m->nid, 3, 0, 0, 0);
+    gsAttrib(color, m->cid, 3, 0, 0, 0);
+    gsIndices(m->iid);
+}
+
+void gsBlend(const unsigned char on)
+{
+    if(gs_blend == on){gs_dropped++; return;}
+    if(on == 1)
+        glEnable(GL_BLEND);
+    else
+        glDisable(GL_BLEND);
+    gs_blend = on;
+    gs_calls++;
+}
+
+void gsFrame()
+{
+    gs_frames++;
+    gs_total += gs_calls;
+    gs_total_dropped += gs_dropped;
+    if(gs_calls > gs_max){gs_max = gs_calls;}
+    gs_calls = 0;
+    gs_dropped = 0;
+}
+
+void gsDump()
+{
+    if(gs_frames == 0){return;}
+    printf("gl calls per frame: %.1f mean, %u max, %.1f dropped as redundant (%s)\n",
+        (double)gs_total / gs_frames, gs_max, (double)gs_total_dropped / gs_frames,
+        gs_vaos == 1 ? "vertex array objects" : "no vertex array objects");
+}
+
+#endif
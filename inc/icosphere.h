@@ -0,0 +1,223 @@
+/*
+    Icosphere by subdivision.
+
+    Starts from the icosahedron and splits every triangle
+    in four level times, pushing each new midpoint out to
+    the sphere. An edge's midpoint is made once and found
+    again from the other triangle through a hash of the
+    edge, so the mesh shares every vertex; a level l
+    sphere has 10*4^l+2 vertices and 20*4^l triangles.
+
+    The vertices of a level are the first vertices of
+    every finer level, new midpoints only ever go on the
+    end, and par holds the two vertices each was made
+    between. The triangles come out in subdivision order,
+    the four children of a triangle next to each other
+    all the way down, so neighbours in the index buffer
+    are neighbours on the sphere; isOrder() numbers the
+    vertices again in the order the triangles first use
+    them so the vertices are the same way. A vertex cache
+    then sees each vertex about twice and any small patch
+    of the sphere is a short run of the vertex buffer.
+
+    Everything is integer bookkeeping around adds,
+    multiplies and sqrtf(), the same mesh on every build.
+
+    Requires:
+        - (nothing)
+*/
+
+#ifndef ICOSPHERE_H
+#define ICOSPHERE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+typedef struct
+{
+    float* v;           // xyz per vertex
+    unsigned int* ind;  // three per triangle, counter clockwise from outside
+    unsigned int* par;  // two per vertex, the ends of the edge it split, the first 12 their own
+    unsigned int nv, ni;
+} icomesh;
+
+int  isMake(icomesh* m, const unsigned int level, const float radius);
+int  isOrder(icomesh* m, unsigned int* from);
+void isFree(icomesh* m);
+
+//
+
+static inline unsigned int isVerts(const unsigned int level){return 10u * (1u << (2*level)) + 2;}
+static inline unsigned int isTris(const unsigned int level){return 20u * (1u << (2*level));}
+
+typedef struct
+{
+    uint64_t* key;  // edge, low vertex << 32 | high vertex, 0 is empty
+    unsigned int* val;
+    unsigned int mask;
+} ismid;
+
+static inline unsigned int isMidpoint(ismid* h, icomesh* m, unsigned int a, unsigned int b)
+{
+    if(a > b){const unsigned int t = a; a = b; b = t;}
+    const uint64_t k = ((uint64_t)a << 32 | b) + 1;
+    unsigned int s = (unsigned int)((k * 0x9e3779b97f4a7c15ULL) >> 32) & h->mask;
+    while(h->key[s] != 0)
+    {
+        if(h->key[s] == k){return h->val[s];}
+        s = (s + 1) & h->mask;
+    }
+
+    const float* p = &m->v[a*3];
+    const float* q = &m->v[b*3];
+    float x = p[0]+q[0], y = p[1]+q[1], z = p[2]+q[2];
+    const float l = 1.f / sqrtf(x*x + y*y + z*z);
+    const unsigned int i = m->nv++;
+    m->par[i*2]   = a;
+    m->par[i*2+1] = b;
+    m->v[i*3]   = x*l;
+    m->v[i*3+1] = y*l;
+    m->v[i*3+2] = z*l;
+    h->key[s] = k;
+    h->val[s] = i;
+    return i;
+}
+
+// returns 0 on success, -1 out of memory or a level that does not fit 32 bits
+int isMake(icomesh* m, const unsigned int level, const float radius)
+{
+    memset(m, 0, sizeof(icomesh));
+    if(level > 12){return -1;}
+    const unsigned int nv = isVerts(level);
+    const unsigned int nt = isTris(level);
+    m->v = malloc((size_t)nv * 3 * sizeof(float));
+    m->ind = malloc((size_t)nt * 3 * sizeof(unsigned int));
+    m->par = malloc((size_t)nv * 2 * sizeof(unsigned int));
+    unsigned int* tmp = malloc((size_t)nt * 3 * sizeof(unsigned int));
+    ismid h = {0};
+    unsigned int hs = 64;
+    while(hs < nv * 2){hs <<= 1;} // every edge of the last level, at half load
+    h.mask = hs - 1;
+    h.key = calloc(hs, sizeof(uint64_t));
+    h.val = malloc(hs * sizeof(unsigned int));
+    if(m->v == NULL || m->ind == NULL || m->par == NULL || tmp == NULL || h.key == NULL || h.val == NULL)
+    {
+        free(tmp);
+        free(h.key);
+        free(h.val);
+        isFree(m);
+        return -1;
+    }
+
+    const float t = (1.f + sqrtf(5.f)) * 0.5f;
+    const float rl = 1.f / sqrtf(1.f + t*t);
+    const float iv[12][3] = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    static const unsigned int it[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+    };
+    for(unsigned int i = 0; i < 12; i++)
+    {
+        m->v[i*3]   = iv[i][0] * rl;
+        m->v[i*3+1] = iv[i][1] * rl;
+        m->v[i*3+2] = iv[i][2] * rl;
+        m->par[i*2] = m->par[i*2+1] = i;
+    }
+    m->nv = 12;
+    memcpy(m->ind, it, sizeof(it));
+    m->ni = 60;
+
+    for(unsigned int l = 0; l < level; l++)
+    {
+        unsigned int* d = tmp;
+        for(unsigned int i = 0; i < m->ni; i += 3)
+        {
+            const unsigned int a = m->ind[i], b = m->ind[i+1], c = m->ind[i+2];
+            const unsigned int ab = isMidpoint(&h, m, a, b);
+            const unsigned int bc = isMidpoint(&h, m, b, c);
+            const unsigned int ca = isMidpoint(&h, m, c, a);
+            d[0] = a;  d[1] = ab; d[2] = ca;
+            d[3] = b;  d[4] = bc; d[5] = ab;
+            d[6] = c;  d[7] = ca; d[8] = bc;
+            d[9] = ab; d[10] = bc; d[11] = ca;
+            d += 12;
+        }
+        m->ni *= 4;
+        unsigned int* s = m->ind; m->ind = tmp; tmp = s;
+    }
+    free(tmp);
+    free(h.key);
+    free(h.val);
+
+    if(radius != 1.f)
+        for(unsigned int i = 0; i < m->nv*3; i++)
+            m->v[i] *= radius;
+    return 0;
+}
+
+// numbers the vertices in the order the triangles first use them, from[new] = old when not NULL
+// returns 0 on success, -1 out of memory
+int isOrder(icomesh* m, unsigned int* from)
+{
+    unsigned int* to = malloc((size_t)m->nv * sizeof(unsigned int));
+    unsigned int* old = from != NULL ? from : malloc((size_t)m->nv * sizeof(unsigned int));
+    float* v = malloc((size_t)m->nv * 3 * sizeof(float));
+    unsigned int* par = malloc((size_t)m->nv * 2 * sizeof(unsigned int));
+    if(to == NULL || old == NULL || v == NULL || par == NULL)
+    {
+        free(to);
+        if(old != from){free(old);}
+        free(v);
+        free(par);
+        return -1;
+    }
+
+    memset(to, 0xff, (size_t)m->nv * sizeof(unsigned int));
+    unsigned int n = 0;
+    for(unsigned int i = 0; i < m->ni; i++)
+    {
+        const unsigned int k = m->ind[i];
+        if(to[k] == 0xffffffff)
+        {
+            to[k] = n;
+            old[n] = k;
+            n++;
+        }
+        m->ind[i] = to[k];
+    }
+    for(unsigned int i = 0; i < m->nv; i++)
+    {
+        const unsigned int k = old[i];
+        v[i*3]   = m->v[k*3];
+        v[i*3+1] = m->v[k*3+1];
+        v[i*3+2] = m->v[k*3+2];
+        par[i*2]   = to[m->par[k*2]];
+        par[i*2+1] = to[m->par[k*2+1]];
+    }
+    free(m->v);
+    free(m->par);
+    m->v = v;
+    m->par = par;
+
+    free(to);
+    if(old != from){free(old);}
+    return 0;
+}
+
+void isFree(icomesh* m)
+{
+    free(m->v);
+    free(m->ind);
+    free(m->par);
+    memset(m, 0, sizeof(icomesh));
+}
+
+#endif
@@ -0,0 +1,194 @@
+/*
+    Coarse levels of the exo over its own vertices.
+
+    ldIndices() makes the icosphere of a lower level and
+    moves each of its vertices to the nearest vertex of
+    the full mesh by direction, so a coarse level is only
+    another index buffer over the same vertex buffer; the
+    craters and colours of the full mesh are in every
+    level as they happen and nothing is uploaded twice.
+    Triangles that fold to a line on the way are dropped.
+    When the full mesh is itself an icosphere the coarse
+    vertices are its own, the nearest is exact.
+
+    ldLevel() guesses the icosphere level of the full mesh
+    from its vertex count, ldEdge() gives the mean edge of
+    an index buffer for choosing a level by how big its
+    triangles would be on screen and ldInside() the
+    largest sphere at the origin no triangle cuts into,
+    the coarser the level the further its flat triangles
+    sink under the sphere its vertices are on.
+
+    Requires:
+        - vec.h
+        - icosphere.h
+*/
+
+#ifndef LOD_H
+#define LOD_H
+
+#include <stdlib.h>
+#include <math.h>
+#include "vec.h"
+#include "icosphere.h"
+
+#define LD_MAX_CELLS 128 // nearest vertex grid per axis
+
+unsigned int ldLevel(const size_t numvert);
+int   ldIndices(GLuint** ind, GLsizeiptr* numind, const unsigned int level, const float* v, const size_t numvert);
+float ldEdge(const float* v, const GLuint* ind, const size_t numind);
+float ldInside(const float* v, const GLuint* ind, const size_t numind);
+
+//
+
+unsigned int ldLevel(const size_t numvert)
+{
+    unsigned int l = 0;
+    while(l < 12 && isVerts(l+1) <= numvert){l++;}
+    return l;
+}
+
+static inline unsigned int ldCell(const float x, const float g)
+{
+    int c = (int)((x + 1.f) * g);
+    if(c < 0){c = 0;}
+    return (unsigned int)c;
+}
+
+// returns 0 on success and a malloc'd index buffer of the level over v, -1 out of memory
+int ldIndices(GLuint** ind, GLsizeiptr* numind, const unsigned int level, const float* v, const size_t numvert)
+{
+    *ind = NULL;
+    *numind = 0;
+    icomesh s;
+    if(isMake(&s, level, 1.f) < 0){return -1;}
+
+    // unit directions of the full mesh in a uniform grid about two vertex spacings wide
+    unsigned int n = (unsigned int)(1.f / sqrtf(4.f*PI / numvert)) + 1;
+    if(n > LD_MAX_CELLS){n = LD_MAX_CELLS;}
+    const float g = n * 0.5f; // cells per unit
+    const size_t nc = (size_t)n*n*n;
+    float* dir = malloc(numvert * 3 * sizeof(float));
+    unsigned int* cell = malloc(numvert * sizeof(unsigned int));
+    unsigned int* start = calloc(nc+1, sizeof(unsigned int));
+    unsigned int* idx = malloc(numvert * sizeof(unsigned int));
+    unsigned int* near = malloc(s.nv * sizeof(unsigned int));
+    *ind = malloc(s.ni * sizeof(GLuint));
+    if(dir == NULL || cell == NULL || start == NULL || idx == NULL || near == NULL || *ind == NULL)
+    {
+        free(dir); free(cell); free(start); free(idx); free(near);
+        free(*ind);
+        *ind = NULL;
+        isFree(&s);
+        return -1;
+    }
+    for(size_t i = 0; i < numvert; i++)
+    {
+        const float* p = &v[i*3];
+        float l = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+        l = l > 0.f ? 1.f / l : 0.f;
+        float* d = &dir[i*3];
+        d[0] = p[0]*l; d[1] = p[1]*l; d[2] = p[2]*l;
+        unsigned int cx = ldCell(d[0], g), cy = ldCell(d[1], g), cz = ldCell(d[2], g);
+        if(cx >= n){cx = n-1;} if(cy >= n){cy = n-1;} if(cz >= n){cz = n-1;}
+        cell[i] = (cz*n + cy)*n + cx;
+        start[cell[i]+1]++;
+    }
+    for(size_t i = 0; i < nc; i++)
+        start[i+1] += start[i];
+    for(size_t i = 0; i < numvert; i++)
+        idx[start[cell[i]]++] = i;
+    for(size_t i = nc; i > 0; i--)
+        start[i] = start[i-1];
+    start[0] = 0;
+
+    // grow the box of cells searched until nothing outside it can be nearer
+    for(unsigned int i = 0; i < s.nv; i++)
+    {
+        const float* q = &s.v[i*3];
+        const int cx = ldCell(q[0], g), cy = ldCell(q[1], g), cz = ldCell(q[2], g);
+        float best = 1e30f;
+        unsigned int bi = 0;
+        for(int r = 1; r <= (int)n; r++)
+        {
+            for(int z = cz-r; z <= cz+r; z++)
+            {
+                if(z < 0 || z >= (int)n){continue;}
+                for(int y = cy-r; y <= cy+r; y++)
+                {
+                    if(y < 0 || y >= (int)n){continue;}
+                    for(int x = cx-r; x <= cx+r; x++)
+                    {
+                        if(x < 0 || x >= (int)n){continue;}
+                        // only the shell of the box is new past the first pass
+                        if(r > 1 && abs(x-cx) < r && abs(y-cy) < r && abs(z-cz) < r){continue;}
+                        const unsigned int c = (z*n + y)*n + x;
+                        for(unsigned int k = start[c]; k < start[c+1]; k++)
+                        {
+                            const float* d = &dir[idx[k]*3];
+                            const float dx = d[0]-q[0], dy = d[1]-q[1], dz = d[2]-q[2];
+                            const float ds = dx*dx + dy*dy + dz*dz;
+                            if(ds < best){best = ds; bi = idx[k];}
+                        }
+                    }
+                }
+            }
+            const float reach = (float)r / g; // every point within this is searched
+            if(best <= reach*reach){break;}
+        }
+        near[i] = bi;
+    }
+
+    GLsizeiptr ni = 0;
+    for(unsigned int i = 0; i < s.ni; i += 3)
+    {
+        const GLuint a = near[s.ind[i]], b = near[s.ind[i+1]], c = near[s.ind[i+2]];
+        if(a == b || b == c || c == a){continue;}
+        (*ind)[ni++] = a;
+        (*ind)[ni++] = b;
+        (*ind)[ni++] = c;
+    }
+    *numind = ni;
+
+    free(dir); free(cell); free(start); free(idx); free(near);
+    isFree(&s);
+    return 0;
+}
+
+float ldEdge(const float* v, const GLuint* ind, const size_t numind)
+{
+    if(numind == 0){return 0.f;}
+    double sum = 0.0;
+    for(size_t i = 0; i < numind; i += 3)
+    {
+        for(int e = 0; e < 3; e++)
+        {
+            const float* p = &v[ind[i+e]*3];
+            const float* q = &v[ind[i+(e+1)%3]*3];
+            const float dx = p[0]-q[0], dy = p[1]-q[1], dz = p[2]-q[2];
+            sum += sqrtf(dx*dx + dy*dy + dz*dz);
+        }
+    }
+    return (float)(sum / numind);
+}
+
+// the least distance from the origin to the plane of any triangle
+float ldInside(const float* v, const GLuint* ind, const size_t numind)
+{
+    float in = 1e30f;
+    for(size_t i = 0; i < numind; i += 3)
+    {
+        const float* a = &v[ind[i]*3];
+        const float* b = &v[ind[i+1]*3];
+        const float* c = &v[ind[i+2]*3];
+        vec n;
+        vCross(&n, (vec){b[0]-a[0], b[1]-a[1], b[2]-a[2]}, (vec){c[0]-a[0], c[1]-a[1], c[2]-a[2]});
+        const float l = vMod(n);
+        if(l == 0.f){continue;}
+        const float d = fabsf(n.x*a[0] + n.y*a[1] + n.z*a[2]) / l;
+        if(d < in){in = d;}
+    }
+    return in;
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+    Append only binary game log and its reader.
+
+    Records everything a tick depends on that does not
+    come from the epoch; the local input and the remote
+    player positions, each only when it changed, then the
+    local player position after every tick and the state
+    hash at every hash checkpoint so a replay can say
+    exactly where it went its own way. Replaying a log
+    through simTick() rebuilds the game it was recorded
+    from, fa-sim -r does it as fast as the cpu allows.
+
+    Records go through a large stdio buffer and are
+    flushed once a second of game time, recording costs
+    the game a few small memcpy a tick.
+
+    layout, little endian:
+        "FAR" RP_VERSION, u32 epoch, u32 SIM_HZ, u32 MAX_PLAYERS, u32 exo level
+        then records, each a type byte and
+        'I' u8 keys, u8 brake, 9 f32 thrust; input from the next tick on
+        'P' u32 changed slot mask, 3 f32 per changed slot; remote players from the next tick on
+        'T' 3 f32 ppr; one tick ran
+        'H' u64 simHash(); at every HASH_CHECK_TICKS
+
+    Requires:
+        - sim.h
+        - snapshot.h
+*/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "sim.h"
+#include "snapshot.h"
+
+#define RP_VERSION 3
+#define RP_BUFFER (1 << 20)
+
+typedef struct
+{
+    FILE* f;
+    uint32_t epoch;
+    uint32_t level;     // of the exo the game was played on, EXO_LEVEL of the build that recorded it
+    uint64_t ticks;     // 'T' records so far
+    unsigned char keys; // bit per keystate[] entry, for reference only
+    siminput in;
+    float players[MAX_PLAYERS*3];
+    vec ppr;            // from the last 'T'
+    uint64_t hash;      // from the last 'H'
+} replay;
+
+int  rpCreate(replay* r, const char* file, const uint32_t epoch);
+void rpInput(replay* r, const siminput* in, const unsigned char keys);
+void rpTicked(replay* r);
+int  rpOpen(replay* r, const char* file);
+int  rpNext(replay* r);
+void rpClose(replay* r);
+
+//
+
+// returns 0 on success, the log starts at tick 0 of epoch
+int rpCreate(replay* r, const char* file, const uint32_t epoch)
+{
+    memset(r, 0, sizeof(replay));
+    r->f = fopen(file, "wb");
+    if(r->f == NULL){return -1;}
+    setvbuf(r->f, NULL, _IOFBF, RP_BUFFER);
+    unsigned char b[20] = {'F', 'A', 'R', RP_VERSION};
+    unsigned char* p = snPutU32(b+4, epoch);
+    p = snPutU32(p, SIM_HZ);
+    p = snPutU32(p, MAX_PLAYERS);
+    p = snPutU32(p, exo_level);
+    fwrite(b, 1, p-b, r->f);
+    r->epoch = epoch;
+    r->level = exo_level;
+    return 0;
+}
+
+// call before each simTick(), writes whatever changed since the last tick
+void rpInput(replay* r, const siminput* in, const unsigned char keys)
+{
+    unsigned char b[1 + 4 + MAX_PLAYERS*3*4];
+    if(keys != r->keys || in->brake != r->in.brake ||
+       memcmp(in->thrust, r->in.thrust, sizeof(in->thrust)) != 0)
+    {
+        unsigned char* p = b;
+        *p++ = 'I';
+        *p++ = keys;
+        *p++ = in->brake;
+        for(unsigned int i = 0; i < 3; i++)
+        {
+            p = snPutF32(p, in->thrust[i].x);
+            p = snPutF32(p, in->thrust[i].y);
+            p = snPutF32(p, in->thrust[i].z);
+        }
+        fwrite(b, 1, p-b, r->f);
+        r->keys = keys;
+        r->in.brake = in->brake;
+        memcpy(r->in.thrust, in->thrust, sizeof(in->thrust));
+    }
+
+    uint32_t mask = 0;
+    unsigned char* p = b+5;
+    for(unsigned int i = 0; i < MAX_PLAYERS; i++)
+    {
+        const float* s = in->players + i*3;
+        float* d = r->players + i*3;
+        if(memcmp(s, d, 3*sizeof(float)) == 0){continue;}
+        mask |= 1u << i;
+        p = snPutF32(p, s[0]);
+        p = snPutF32(p, s[1]);
+        p = snPutF32(p, s[2]);
+        memcpy(d, s, 3*sizeof(float));
+    }
+    if(mask != 0)
+    {
+        b[0] = 'P';
+        snPutU32(b+1, mask);
+        fwrite(b, 1, p-b, r->f);
+    }
+}
+
+// call after each simTick()
+void rpTicked(replay* r)
+{
+    unsigned char b[13] = {'T'};
+    unsigned char* p = snPutF32(b+1, ppr.x);
+    p = snPutF32(p, ppr.y);
+    p = snPutF32(p, ppr.z);
+    fwrite(b, 1, p-b, r->f);
+    r->ticks++;
+    if(sim_tick % HASH_CHECK_TICKS == 0)
+    {
+        b[0] = 'H';
+        snPutU64(b+1, simHash());
+        fwrite(b, 1, 9, r->f);
+        fflush(r->f);
+    }
+}
+
+// returns 0 on success, -1 if the file is not a log for this build
+int rpOpen(replay* r, const char* file)
+{
+    memset(r, 0, sizeof(replay));
+    r->f = fopen(file, "rb");
+    if(r->f == NULL){return -1;}
+    setvbuf(r->f, NULL, _IOFBF, RP_BUFFER);
+    unsigned char b[20];
+    const unsigned char* p = b+4;
+    if(fread(b, 1, 20, r->f) != 20 || b[0] != 'F' || b[1] != 'A' || b[2] != 'R' || b[3] != RP_VERSION){rpClose(r); return -1;}
+    r->epoch = snGetU32(&p);
+    if(snGetU32(&p) != SIM_HZ || snGetU32(&p) != MAX_PLAYERS){rpClose(r); return -1;}
+    r->level = snGetU32(&p);
+    if(r->level != EXO_LEVEL){rpClose(r); return -1;}
+    r->in.players = r->players;
+    return 0;
+}
+
+// reads the next record into r, returns its type, 0 at the end of the log or -1 if it is cut short
+int rpNext(replay* r)
+{
+    unsigned char b[MAX_PLAYERS*3*4];
+    const unsigned char* p = b;
+    const int t = fgetc(r->f);
+    if(t == EOF){return 0;}
+    if(t == 'I')
+    {
+        if(fread(b, 1, 2 + 9*4, r->f) != 2 + 9*4){return -1;}
+        r->keys = *p++;
+        r->in.brake = *p++;
+        for(unsigned int i = 0; i < 3; i++)
+        {
+            r->in.thrust[i].x = snGetF32(&p);
+            r->in.thrust[i].y = snGetF32(&p);
+            r->in.thrust[i].z = snGetF32(&p);
+        }
+    }
+    else if(t == 'P')
+    {
+        if(fread(b, 1, 4, r->f) != 4){return -1;}
+        const uint32_t mask = snGetU32(&p);
+        const size_t n = __builtin_popcount(mask) * 3 * 4;
+        if(fread(b, 1, n, r->f) != n){return -1;}
+        p = b;
+        for(unsigned int i = 0; i < MAX_PLAYERS; i++)
+        {
+            if((mask & (1u << i)) == 0){continue;}
+            r->players[i*3]   = snGetF32(&p);
+            r->players[i*3+1] = snGetF32(&p);
+            r->players[i*3+2] = snGetF32(&p);
+        }
+    }
+    else if(t == 'T')
+    {
+        if(fread(b, 1, 12, r->f) != 12){return -1;}
+        r->ppr.x = snGetF32(&p);
+        r->ppr.y = snGetF32(&p);
+        r->ppr.z = snGetF32(&p);
+        r->ticks++;
+    }
+    else if(t == 'H')
+    {
+        if(fread(b, 1, 8, r->f) != 8){return -1;}
+        r->hash = snGetU64(&p);
+    }
+    else
+        return -1;
+    return t;
+}
+
+void rpClose(replay* r)
+{
+    if(r->f != NULL){fclose(r->f);}
+    r->f = NULL;
+}
+
+#endif
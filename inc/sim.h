@@ -0,0 +1,438 @@
+/*
+    The shared game simulation, without any GL.
+
+    Everything every client has to agree on lives here;
+    the comet field seeded from the start epoch, the exo
+    craters and damage, the local player movement and the
+    player vs comet collisions. main.c renders this state
+    and fa-sim.c runs it headless as fast as it can.
+
+    simExo() turns the baked exo mesh into the crater
+    mesh, call it once the mesh has been scaled by
+    GFX_SCALE and before simInit(). simTick() then
+    advances the world by one fixed SIM_DT step.
+
+    Requires:
+        - vec.h
+        - comets.h
+        - cgrid.h
+        - exogrid.h
+        - simhash.h
+        - crand.h
+        - assets/exo.h
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "vec.h"
+#include "comets.h"
+#include "cgrid.h"
+#include "exogrid.h"
+#include "simhash.h"
+#include "crand.h"
+#include "../assets/exo.h"
+
+#define GFX_SCALE 0.01f
+#define MOVE_SPEED 0.5f
+#define MAX_PLAYERS 31
+#define NUM_COMETS 64
+#define COMET_MAX_SPEED 0.24f
+
+// fixed rate simulation
+#define SIM_HZ 120
+#define SIM_DT (1.f/(float)SIM_HZ)
+#define HASH_CHECK_TICKS SIM_HZ
+
+// hooks around the crater pass and each crater in it, the game times and traces them
+#ifndef SIM_EXO_BEGIN
+    #define SIM_EXO_BEGIN()
+    #define SIM_EXO_END()
+#endif
+#ifndef SIM_IMPACT_BEGIN
+    #define SIM_IMPACT_BEGIN()
+    #define SIM_IMPACT_END()
+#endif
+
+typedef struct
+{
+    vec p;
+    float f;
+} impact;
+
+// everything from outside the simulation the next tick uses
+typedef struct
+{
+    vec thrust[3];  // signed view axes of the held move keys, zero if none
+    unsigned int brake;
+    const float* players; // MAX_PLAYERS*3 remote player positions, a slot of zeros is empty
+} siminput;
+
+cstore comets;
+unsigned int comet_spawns[NUM_COMETS]; // respawns so far, keys the comet's next random stream
+uint32_t sim_seed = 0;
+cgrid comet_grid; // broad phase, cell is twice the largest live comet scale
+unsigned int comet_near[NUM_COMETS];
+exogrid exo_grid;
+float* exo_base;        // the crater mesh before any impact
+float* exo_base_colors;
+
+impact impacts[NUM_COMETS]; // exo impacts found this tick
+unsigned int num_impacts = 0;
+unsigned int impact_bound = 0;  // most damage the impacts waiting in impacts[] can do
+unsigned int impact_reach = 0;  // vertices they can spill, later craters can reach those too
+
+// every impact applied since the renderer last took them, the count
+// keeps going past IMPACT_LOG_MAX so the renderer knows it missed some
+#define IMPACT_LOG_MAX 256
+impact impact_log[IMPACT_LOG_MAX];
+unsigned int impact_log_n = 0;
+
+vec pp = {0.f, 0.f, 0.f};       // player velocity
+vec ppr = {0.f, 0.f, -2.3f};    // player position
+vec ppr_prev;                   // ppr at the start of the last tick
+float player_pos[(MAX_PLAYERS+1)*3];  // active players this tick, local first, as comet space positions
+
+unsigned int hits = 0;
+unsigned int popped = 0;
+unsigned int damage = 0;
+unsigned int score_dirty = 0;   // hits or popped changed
+
+uint64_t sim_tick = 0;     // ticks since sepoch
+uint64_t comet_hash = 0;   // chained over every randComet()
+uint64_t hash_check = 0;   // checkpoint second << 32 | low 32 bits of the state hash
+
+void simExo();
+int  simInit(const int seed);
+void simTick(const siminput* in);
+static inline uint64_t simHash();
+static inline size_t simPlayersIn(float* players, const void* data, const size_t len);
+
+//
+
+// comet_hash only sees respawns, so the live comets are folded in here
+// each time the hash is taken; 64 comets once every HASH_CHECK_TICKS
+static inline uint64_t simHash()
+{
+    uint64_t h = comet_hash ^ exo_grid.hash;
+    for(unsigned int i = 0; i < NUM_COMETS; i++)
+    {
+        const float p[3] = {comets.px[i], comets.py[i], comets.pz[i]};
+        const float d[3] = {comets.dx[i], comets.dy[i], comets.dz[i]};
+        h = shComet(h, i, p, d, comets.scale[i], comets.speed[i]);
+    }
+    return h;
+}
+
+// a player list from the server into players, returns the bytes taken, 0 if it is not one
+static inline size_t simPlayersIn(float* players, const void* data, const size_t len)
+{
+    if(len <= 11 || len > MAX_PLAYERS*3*sizeof(float)){return 0;}
+    memcpy(players, data, len);
+    return len;
+}
+
+void doExoImpact(vec p, float f)
+{
+    //if(f < 0.003793040058F){return;}
+    damage += egImpact(&exo_grid, exo_vertices, exo_colors, p, f);
+}
+
+void randComet(unsigned int i)
+{
+    // the nth respawn of comet i is the same no matter what else happened
+    crstream r = crStream(crKey(sim_seed, i, comet_spawns[i]++));
+
+    vec pos, dir;
+    crRuvBT(&r, &pos);
+    vMulS(&pos, pos, 10.f);
+
+    vec dp;
+    crRuvTA(&r, &dp);
+    vSub(&dir, pos, dp);
+    vNorm(&dir);
+    vInv(&dir);
+
+    vec of = dir;
+    vInv(&of);
+    vMulS(&of, of, crRandf(&r)*6.f);
+    vAdd(&pos, pos, of);
+
+    csSetPos(&comets, i, pos);
+    csSetDir(&comets, i, dir);
+    comets.rot[i] = crRandf(&r)*300.f;
+    comets.scale[i] = 0.01f+(crRandf(&r)*0.07f);
+    comets.speed[i] = 0.16f+(crRandf(&r)*0.08f);
+    cgMove(&comet_grid, i, pos);
+    comet_hash = shComet(comet_hash, i, &pos.x, &dir.x, comets.scale[i], comets.speed[i]);
+
+    // no interpolation across a respawn
+    comets.qx[i] = pos.x;
+    comets.qy[i] = pos.y;
+    comets.qz[i] = pos.z;
+}
+
+void randComets()
+{
+    for(unsigned int i = 0; i < NUM_COMETS; i++)
+        randComet(i);
+}
+
+void incrementHits()
+{
+    hits++;
+    score_dirty = 1;
+
+    const unsigned int max_damage = exo_numvert/2;
+    if(damage >= max_damage)
+    {
+        for(unsigned int i = 0; i < NUM_COMETS; i++)
+        {
+            comets.speed[i] = -1.f;
+            comets.rot[i] = 0.f;
+        }
+    }
+}
+
+void applyImpacts()
+{
+    // in comet order, as if each had landed on its own
+    impact_bound = 0;
+    impact_reach = 0;
+    if(num_impacts == 0){return;}
+    SIM_EXO_BEGIN();
+    const unsigned int max_damage = exo_numvert/2;
+    for(unsigned int i = 0; i < num_impacts && damage < max_damage; i++)
+    {
+        SIM_IMPACT_BEGIN();
+        doExoImpact(impacts[i].p, impacts[i].f);
+        SIM_IMPACT_END();
+        if(impact_log_n < IMPACT_LOG_MAX){impact_log[impact_log_n] = impacts[i];}
+        impact_log_n++;
+        incrementHits();
+    }
+    num_impacts = 0;
+    SIM_EXO_END();
+}
+
+void simExo()
+{
+    // sink the darker vertices and lift the shell off the inner planet
+    const size_t s = exo_numvert*3;
+    for(size_t i = 0; i < s; i+=3)
+    {
+        const float g = (exo_colors[i] + exo_colors[i+1] + exo_colors[i+2]) / 3;
+        const float h = (1.f-g)*0.01f;
+        vec v = {exo_vertices[i], exo_vertices[i+1], exo_vertices[i+2]};
+        vNorm(&v);
+        vMulS(&v, v, h);
+        exo_vertices[i]   -= v.x;
+        exo_vertices[i+1] -= v.y;
+        exo_vertices[i+2] -= v.z;
+        exo_vertices[i]   *= 1.03f;
+        exo_vertices[i+1] *= 1.03f;
+        exo_vertices[i+2] *= 1.03f;
+    }
+}
+
+int simInit(const int seed)
+{
+    const size_t bytes = exo_numvert * 3 * sizeof(float);
+    exo_base = malloc(bytes);
+    exo_base_colors = malloc(bytes);
+    if(exo_base == NULL || exo_base_colors == NULL){return -1;}
+    memcpy(exo_base, exo_vertices, bytes);
+    memcpy(exo_base_colors, exo_colors, bytes);
+    if(egBuild(&exo_grid, exo_vertices, exo_numvert) < 0){return -1;}
+    if(csInit(&comets, NUM_COMETS) < 0){return -1;}
+    if(cgInit(&comet_grid, NUM_COMETS, 0.16f) < 0){return -1;}
+
+    // tick 0 is the epoch
+    sim_seed = (uint32_t)seed;
+    memset(comet_spawns, 0, sizeof(comet_spawns));
+    randComets();
+    ppr_prev = ppr;
+    sim_tick = 0;
+    return 0;
+}
+
+// the comet pass on the positions csIntegrate() left
+void simComets()
+{
+    const float dt = SIM_DT;
+    const unsigned int max_damage = exo_numvert/2;
+    for(unsigned int i = 0; i < NUM_COMETS; i++)
+    {
+        if(comets.speed[i] == 0.f) // explode
+        {
+            comets.dx[i] -= 0.3f*dt;
+            comets.scale[i] -= 0.03f*dt;
+            if(comets.dx[i] <= 0.f || comets.scale[i] <= 0.f)
+                randComet(i);
+        }
+        else if(comets.speed[i] != -1.f) // detect impacts
+        {
+            // planet impact
+            if(comets.hit[i] == 1)
+            {
+                const vec ip = csPos(&comets, i);
+                const float f = (comets.scale[i]+(comets.speed[i]*0.1f))*1.2f;
+                impacts[num_impacts++] = (impact){ip, f};
+
+                comets.px[i] += comets.dx[i]*0.03f;
+                comets.py[i] += comets.dy[i]*0.03f;
+                comets.pz[i] += comets.dz[i]*0.03f;
+                cgMove(&comet_grid, i, csPos(&comets, i));
+                comets.speed[i] = 0.f;
+                comets.dx[i] = 1.f;
+                comets.scale[i] *= 2.f;
+
+                // the craters wait for the end of the pass unless this one could end
+                // the game, then they land now and the comets after it never get a turn
+                const unsigned int b = egBound(&exo_grid, ip, f);
+                if(damage + impact_bound + b + impact_reach < max_damage)
+                {
+                    impact_bound += b + impact_reach;
+                    impact_reach += b - exo_grid.nspill;
+                    continue;
+                }
+                applyImpacts();
+                if(damage >= max_damage)
+                {
+                    for(unsigned int k = i+1; k < NUM_COMETS; k++)
+                    {
+                        comets.px[k] = comets.qx[k];
+                        comets.py[k] = comets.qy[k];
+                        comets.pz[k] = comets.qz[k];
+                        cgMove(&comet_grid, k, csPos(&comets, k));
+                    }
+                    return;
+                }
+                continue;
+            }
+
+            // player impact, only our own pops count
+            if(comets.near[i] != 0)
+            {
+                if(comets.near[i] & CS_NEAR_LOCAL)
+                {
+                    popped++;
+                    score_dirty = 1;
+                }
+                comets.speed[i] = 0.f;
+                comets.dx[i] = 1.f;
+                //comets.scale[i] *= 2.f;
+            }
+
+            // comet impact, the comets after this one have not had their turn yet so are
+            // where they were before this tick's move, the grid has them up to a step away
+            const vec cp = csPos(&comets, i);
+            const unsigned int nn = cgQuery(&comet_grid, cp, comets.scale[i] + COMET_MAX_SPEED*dt, comet_near);
+            for(unsigned int n = 0; n < nn; n++)
+            {
+                const unsigned int k = comet_near[n];
+                if(k == i){continue;}
+                const vec kp = k > i ? (vec){comets.qx[k], comets.qy[k], comets.qz[k]} : csPos(&comets, k);
+                const float cd = vDistSq(cp, kp);
+                if(cd < comets.scale[i]*comets.scale[i])
+                {
+                    comets.speed[i] = 0.f;
+                    comets.dx[i] = 1.f;
+                    comets.speed[k] = 0.f;
+                    comets.dx[k] = 1.f;
+
+                    // stopped before its turn, it never moved
+                    if(k > i)
+                    {
+                        csSetPos(&comets, k, kp);
+                        cgMove(&comet_grid, k, kp);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void simTick(const siminput* in)
+{
+    const float dt = SIM_DT; // fixed, not the frame delta
+
+    ppr_prev = ppr;
+
+//*************************************
+// player
+//*************************************
+
+    for(unsigned int i = 0; i < 3; i++)
+    {
+        vec m;
+        vMulS(&m, in->thrust[i], MOVE_SPEED * dt);
+        vAdd(&pp, pp, m);
+    }
+
+    if(in->brake == 1)
+        vMulS(&pp, pp, 0.99f*(1.f-dt));
+
+    vec ppi = pp;
+    vMulS(&ppi, ppi, dt);
+    vAdd(&ppr, ppr, ppi);
+
+    const float pmod = vMod(ppr);
+    if(pmod < 1.13f) // exo collision
+    {
+        vec n = ppr;
+        vNorm(&n);
+         vReflect(&pp, pp, (vec){-n.x, -n.y, -n.z}); // better if I don't normalise pp
+         vMulS(&pp, pp, 0.3f);
+        vMulS(&n, n, 1.13f - pmod);
+        vAdd(&ppr, ppr, n);
+    }
+
+//*************************************
+// comets
+//*************************************
+
+    // gather every active player, us first
+    unsigned int np = 1;
+    player_pos[0] = -ppr.x;
+    player_pos[1] = -ppr.y;
+    player_pos[2] = -ppr.z;
+    for(unsigned int i = 0; i < MAX_PLAYERS; i++)
+    {
+        const unsigned int j = i*3;
+        const float* rp = in->players;
+        if(rp[j] != 0.f || rp[j+1] != 0.f || rp[j+2] != 0.f)
+        {
+            player_pos[np*3]   = -rp[j];
+            player_pos[np*3+1] = -rp[j+1];
+            player_pos[np*3+2] = -rp[j+2];
+            np++;
+        }
+    }
+
+    // move every live comet and flag the ones that reached the planet or a player, then
+    // go through them in index order as if each moved on its turn; a comet is tested
+    // against the ones before it where they ended up and the ones after it where they
+    // were, and one stopped before its turn stays where it was and explodes instead
+    csIntegrate(&comets, dt);
+    csPlanet(&comets, 1.14f);
+    csPlayers(&comets, player_pos, np, 0.06f);
+    for(unsigned int i = 0; i < NUM_COMETS; i++)
+        if(comets.speed[i] > 0.f)
+            cgMove(&comet_grid, i, csPos(&comets, i));
+
+    simComets();
+
+    // deform the exo once for every impact this tick
+    applyImpacts();
+
+    sim_tick++;
+    if(sim_tick % HASH_CHECK_TICKS == 0)
+    {
+        const uint64_t h = simHash();
+        __atomic_store_n(&hash_check, ((sim_tick / HASH_CHECK_TICKS) << 32) | (h & 0xFFFFFFFF), __ATOMIC_RELAXED);
+    }
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+    Incremental hash of the shared simulation state.
+
+    Clients compare these to notice when their comet
+    fields or exo damage have drifted apart. The exo is
+    never re-hashed from scratch; its hash is a sum of
+    per vertex hashes so a moved vertex only swaps its
+    own term. The comet hash is chained on every respawn
+    in index order which every client shares, and the
+    few live comets are chained on top of it whenever
+    the hash is taken.
+*/
+
+#ifndef SIMHASH_H
+#define SIMHASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+// splitmix64 finaliser
+static inline uint64_t shMix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint64_t shBits(const float a, const float b)
+{
+    uint32_t ia, ib;
+    memcpy(&ia, &a, 4);
+    memcpy(&ib, &b, 4);
+    return ((uint64_t)ia << 32) | ib;
+}
+
+// the term vertex i adds to the exo hash
+static inline uint64_t shVertex(const unsigned int i, const float x, const float y, const float z)
+{
+    return shMix(shMix(shBits(x, y) ^ i) ^ shBits(z, (float)i));
+}
+
+// chain a freshly spawned comet onto h
+static inline uint64_t shComet(const uint64_t h, const unsigned int i, const float* p, const float* d, const float scale, const float speed)
+{
+    uint64_t r = shMix(h ^ i);
+    r = shMix(r ^ shBits(p[0], p[1]));
+    r = shMix(r ^ shBits(p[2], d[0]));
+    r = shMix(r ^ shBits(d[1], d[2]));
+    return shMix(r ^ shBits(scale, speed));
+}
+
+#endif
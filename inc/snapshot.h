@@ -0,0 +1,280 @@
+/*
+    Versioned binary snapshot of the simulation.
+
+    Everything that can not be rebuilt from the start
+    epoch; the tick, the seed, the score counters,
+    every comet and the exo craters. Comets are stored as
+    raw floats. Craters only move a vertex a little and
+    darken it by 0.2 per hit, so each changed vertex is
+    stored as the difference between the bits of each of
+    its floats and those of the pristine mesh, and its
+    hit count, delta coded by index as varints; a snapshot ten
+    minutes into a game is about 240 kilobytes where a
+    raw copy of the exo vertices and colors is about a
+    megabyte.
+
+    Everything is restored bit for bit, so the exo hash
+    is rebuilt from the vertices and a restored game plays
+    on exactly as the saved one would have.
+
+    layout, little endian:
+        "FAS" SNAP_VERSION
+        u64 sim_tick, u32 seed, u32 damage, hits, popped
+        u64 comet_hash
+        u32 comets, then per comet 9 f32; pos, dir, rot, scale, speed
+            and u32 respawns
+        u32 vertices, u32 changed, then per changed vertex
+            varint index delta, 3 zigzag varint bit deltas x y z, varint hits
+
+    Requires:
+        - sim.h
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "sim.h"
+
+#define SNAP_VERSION 4
+
+size_t simSaveSize();
+size_t simSave(unsigned char* b, const size_t cap);
+int    simLoad(const unsigned char* b, const size_t len);
+
+//
+
+static inline unsigned char* snPutU32(unsigned char* b, const uint32_t v)
+{
+    b[0] = v; b[1] = v >> 8; b[2] = v >> 16; b[3] = v >> 24;
+    return b+4;
+}
+
+static inline unsigned char* snPutU64(unsigned char* b, const uint64_t v)
+{
+    b = snPutU32(b, (uint32_t)v);
+    return snPutU32(b, (uint32_t)(v >> 32));
+}
+
+static inline unsigned char* snPutF32(unsigned char* b, const float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    return snPutU32(b, v);
+}
+
+static inline unsigned char* snPutVar(unsigned char* b, uint32_t v)
+{
+    while(v >= 0x80)
+    {
+        *b++ = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    *b++ = v;
+    return b;
+}
+
+static inline uint32_t snGetU32(const unsigned char** b)
+{
+    const unsigned char* p = *b;
+    *b += 4;
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t snGetU64(const unsigned char** b)
+{
+    const uint64_t lo = snGetU32(b);
+    return lo | (uint64_t)snGetU32(b) << 32;
+}
+
+static inline float snGetF32(const unsigned char** b)
+{
+    const uint32_t v = snGetU32(b);
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+}
+
+// returns -1 on a truncated or overlong varint
+static inline int snGetVar(const unsigned char** b, const unsigned char* end, uint32_t* v)
+{
+    *v = 0;
+    for(unsigned int s = 0; s < 35; s += 7)
+    {
+        if(*b >= end){return -1;}
+        const unsigned char c = *(*b)++;
+        *v |= (uint32_t)(c & 0x7F) << s;
+        if((c & 0x80) == 0){return 0;}
+    }
+    return -1;
+}
+
+static inline uint32_t snBits(const float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, 4);
+    return v;
+}
+
+// zigzag of the difference between the bits of two floats
+static inline uint32_t snDelta(const float f, const float base)
+{
+    const int32_t d = (int32_t)(snBits(f) - snBits(base));
+    return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static inline float snUndelta(const uint32_t zz, const float base)
+{
+    const uint32_t v = snBits(base) + ((zz >> 1) ^ -(zz & 1));
+    float f;
+    memcpy(&f, &v, 4);
+    return f;
+}
+
+// number of 0.2 darkenings between the pristine and current color
+static inline uint32_t snHits(const float c0, const float c)
+{
+    const float k = (c0 - c) * 5.f;
+    return k > 0.f ? (uint32_t)(k + 0.5f) : 0;
+}
+
+// worst case size of a snapshot of the current state
+size_t simSaveSize()
+{
+    return 4 + 8 + 4*4 + 8 + 4 + NUM_COMETS*10*4 + 8 + (size_t)exo_numvert*(5+5*3+5);
+}
+
+// returns the snapshot size or 0 if cap is too small
+size_t simSave(unsigned char* b, const size_t cap)
+{
+    if(cap < simSaveSize()){return 0;}
+    unsigned char* p = b;
+    *p++ = 'F'; *p++ = 'A'; *p++ = 'S'; *p++ = SNAP_VERSION;
+    p = snPutU64(p, sim_tick);
+    p = snPutU32(p, sim_seed);
+    p = snPutU32(p, damage);
+    p = snPutU32(p, hits);
+    p = snPutU32(p, popped);
+    p = snPutU64(p, comet_hash);
+
+    p = snPutU32(p, NUM_COMETS);
+    for(unsigned int i = 0; i < NUM_COMETS; i++)
+    {
+        p = snPutF32(p, comets.px[i]); p = snPutF32(p, comets.py[i]); p = snPutF32(p, comets.pz[i]);
+        p = snPutF32(p, comets.dx[i]); p = snPutF32(p, comets.dy[i]); p = snPutF32(p, comets.dz[i]);
+        p = snPutF32(p, comets.rot[i]); p = snPutF32(p, comets.scale[i]); p = snPutF32(p, comets.speed[i]);
+        p = snPutU32(p, comet_spawns[i]);
+    }
+
+    // the changed count is patched in once known
+    p = snPutU32(p, exo_numvert);
+    unsigned char* pc = p;
+    p += 4;
+    uint32_t nc = 0, last = 0;
+    for(uint32_t i = 0; i < (uint32_t)exo_numvert; i++)
+    {
+        const uint32_t j = i*3;
+        if(exo_vertices[j] == exo_base[j] && exo_vertices[j+1] == exo_base[j+1] && exo_vertices[j+2] == exo_base[j+2] &&
+           exo_colors[j] == exo_base_colors[j]){continue;}
+
+        p = snPutVar(p, i - last);
+        p = snPutVar(p, snDelta(exo_vertices[j],   exo_base[j]));
+        p = snPutVar(p, snDelta(exo_vertices[j+1], exo_base[j+1]));
+        p = snPutVar(p, snDelta(exo_vertices[j+2], exo_base[j+2]));
+        p = snPutVar(p, snHits(exo_base_colors[j], exo_colors[j]));
+        last = i;
+        nc++;
+    }
+    snPutU32(pc, nc);
+    return p - b;
+}
+
+// returns 0 on success, -1 if the snapshot is not for this build or broken
+int simLoad(const unsigned char* b, const size_t len)
+{
+    const unsigned char* end = b + len;
+    if(len < 4 + 8 + 4*4 + 8 + 4 || b[0] != 'F' || b[1] != 'A' || b[2] != 'S' || b[3] != SNAP_VERSION){return -1;}
+    b += 4;
+    const uint64_t tick = snGetU64(&b);
+    const uint32_t seed = snGetU32(&b);
+    const uint32_t dmg = snGetU32(&b);
+    const uint32_t hts = snGetU32(&b);
+    const uint32_t pop = snGetU32(&b);
+    const uint64_t ch = snGetU64(&b);
+
+    if(snGetU32(&b) != NUM_COMETS || end - b < NUM_COMETS*10*4 + 8){return -1;}
+    const unsigned char* cb = b;
+    b += NUM_COMETS*10*4;
+    if(snGetU32(&b) != (uint32_t)exo_numvert){return -1;}
+    const uint32_t nc = snGetU32(&b);
+
+    // check the whole crater list before touching any state
+    const unsigned char* vb = b;
+    for(uint32_t k = 0, i = 0; k < nc; k++)
+    {
+        uint32_t di, zx, zy, zz, nh;
+        if(snGetVar(&vb, end, &di) < 0 || snGetVar(&vb, end, &zx) < 0 || snGetVar(&vb, end, &zy) < 0 ||
+           snGetVar(&vb, end, &zz) < 0 || snGetVar(&vb, end, &nh) < 0){return -1;}
+        i += di;
+        if(i >= (uint32_t)exo_numvert){return -1;}
+    }
+
+    // and make the new broad phase, nothing can fail past here
+    cgrid cg;
+    if(cgInit(&cg, NUM_COMETS, 0.16f) < 0){return -1;}
+
+    // craters onto the pristine mesh, colors replay the same float ops
+    const size_t bytes = exo_numvert * 3 * sizeof(float);
+    memcpy(exo_vertices, exo_base, bytes);
+    memcpy(exo_colors, exo_base_colors, bytes);
+    uint32_t i = 0;
+    for(uint32_t k = 0; k < nc; k++)
+    {
+        uint32_t di, zx, zy, zz, nh;
+        snGetVar(&b, end, &di);
+        snGetVar(&b, end, &zx);
+        snGetVar(&b, end, &zy);
+        snGetVar(&b, end, &zz);
+        snGetVar(&b, end, &nh);
+        i += di;
+        const uint32_t j = i*3;
+        exo_vertices[j]   = snUndelta(zx, exo_base[j]);
+        exo_vertices[j+1] = snUndelta(zy, exo_base[j+1]);
+        exo_vertices[j+2] = snUndelta(zz, exo_base[j+2]);
+        for(uint32_t h = 0; h < nh; h++)
+        {
+            exo_colors[j]   -= 0.2f;
+            exo_colors[j+1] -= 0.2f;
+            exo_colors[j+2] -= 0.2f;
+        }
+    }
+    egReset(&exo_grid, exo_numvert);
+    egSync(&exo_grid, exo_vertices, exo_base, exo_numvert);
+
+    // comets, the broad phase is rebuilt from scratch
+    cgFree(&comet_grid);
+    comet_grid = cg;
+    for(unsigned int i = 0; i < NUM_COMETS; i++)
+    {
+        comets.px[i] = snGetF32(&cb); comets.py[i] = snGetF32(&cb); comets.pz[i] = snGetF32(&cb);
+        comets.dx[i] = snGetF32(&cb); comets.dy[i] = snGetF32(&cb); comets.dz[i] = snGetF32(&cb);
+        comets.rot[i] = snGetF32(&cb); comets.scale[i] = snGetF32(&cb); comets.speed[i] = snGetF32(&cb);
+        comet_spawns[i] = snGetU32(&cb);
+        comets.qx[i] = comets.px[i];
+        comets.qy[i] = comets.py[i];
+        comets.qz[i] = comets.pz[i];
+        cgMove(&comet_grid, i, csPos(&comets, i));
+    }
+
+    sim_tick = tick;
+    sim_seed = seed;
+    damage = dmg;
+    hits = hts;
+    popped = pop;
+    comet_hash = ch;
+    num_impacts = 0;
+    impact_log_n = IMPACT_LOG_MAX+1; // renderer has to take the whole mesh
+    score_dirty = 1;
+    return 0;
+}
+
+#endif
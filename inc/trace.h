@@ -0,0 +1,202 @@
+/*
+    Chrome trace event export.
+
+    Spans go into a ring per thread that only that thread
+    writes, so recording one is two clock reads and a
+    store; a writer thread drains every ring to the JSON
+    file every TR_FLUSH_MS and the frame never touches the
+    file. Open the file in chrome://tracing or
+    ui.perfetto.dev to see the render thread and the net
+    thread on one timeline.
+
+    Call trThread() once at the start of every thread
+    that records, then trStart()/trStop() at any time.
+    While tracing is off trBegin() returns 0 and trEnd()
+    does nothing. Span names have to be string literals,
+    the writer reads them later. A full ring drops spans
+    and says how many at trStop().
+
+    Requires:
+        - pthread
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TR_EVENTS 16384 // per thread, power of two
+#define TR_MAX_THREADS 8
+#define TR_FLUSH_MS 100
+
+typedef struct
+{
+    const char* name;
+    uint64_t ts, dur; // nanoseconds
+} trevent;
+
+typedef struct
+{
+    trevent ev[TR_EVENTS];
+    uint64_t head, tail;
+    uint64_t dropped;       // written by the owner only
+    unsigned int session;   // the trace dropped is for, the owner zeroes it in a new one
+    unsigned int tid;
+    const char* name;
+    unsigned int named; // in this trace yet
+} trbuf;
+
+trbuf* tr_threads[TR_MAX_THREADS];
+unsigned int tr_nthreads = 0;
+__thread trbuf* tr_local = NULL;
+int tr_on = 0;
+unsigned int tr_session = 0; // trStart() count
+FILE* tr_file = NULL;
+uint64_t tr_epoch = 0;
+unsigned int tr_first = 1;
+pthread_t tr_writer;
+
+int  trThread(const char* name);
+int  trStart(const char* file);
+void trStop();
+static inline uint64_t trBegin();
+static inline void trEnd(const char* name, const uint64_t st);
+
+//
+
+static inline uint64_t trNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+// returns 0 on success, -1 if out of memory or threads
+int trThread(const char* name)
+{
+    trbuf* b = calloc(1, sizeof(trbuf));
+    if(b == NULL){return -1;}
+    const unsigned int i = __atomic_fetch_add(&tr_nthreads, 1, __ATOMIC_ACQ_REL);
+    if(i >= TR_MAX_THREADS){free(b); return -1;}
+    b->tid = i+1;
+    b->name = name;
+    tr_local = b;
+    __atomic_store_n(&tr_threads[i], b, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static inline uint64_t trBegin()
+{
+    if(__atomic_load_n(&tr_on, __ATOMIC_RELAXED) == 0){return 0;}
+    return trNow();
+}
+
+static inline void trEnd(const char* name, const uint64_t st)
+{
+    trbuf* b = tr_local;
+    if(st == 0 || b == NULL){return;}
+    const uint64_t h = b->head;
+    if(h - __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE) >= TR_EVENTS)
+    {
+        const unsigned int s = __atomic_load_n(&tr_session, __ATOMIC_RELAXED);
+        uint64_t d = b->dropped;
+        if(b->session != s){__atomic_store_n(&b->session, s, __ATOMIC_RELAXED); d = 0;}
+        __atomic_store_n(&b->dropped, d+1, __ATOMIC_RELAXED);
+        return;
+    }
+    b->ev[h & (TR_EVENTS-1)] = (trevent){name, st, trNow() - st};
+    __atomic_store_n(&b->head, h+1, __ATOMIC_RELEASE);
+}
+
+void trDrain()
+{
+    const unsigned int n = __atomic_load_n(&tr_nthreads, __ATOMIC_ACQUIRE);
+    for(unsigned int i = 0; i < n && i < TR_MAX_THREADS; i++)
+    {
+        trbuf* b = __atomic_load_n(&tr_threads[i], __ATOMIC_ACQUIRE);
+        if(b == NULL){continue;}
+        if(b->named == 0)
+        {
+            fprintf(tr_file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                tr_first ? "" : ",", b->tid, b->name);
+            tr_first = 0;
+            b->named = 1;
+        }
+        const uint64_t h = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+        uint64_t t = b->tail;
+        for(; t < h; t++)
+        {
+            const trevent* e = &b->ev[t & (TR_EVENTS-1)];
+            if(e->ts < tr_epoch){continue;} // from before this trace
+            fprintf(tr_file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                tr_first ? "" : ",", e->name, b->tid, (double)(e->ts - tr_epoch) * 0.001, (double)e->dur * 0.001);
+            tr_first = 0;
+        }
+        __atomic_store_n(&b->tail, t, __ATOMIC_RELEASE);
+    }
+}
+
+void *trWriter(void *arg)
+{
+    while(__atomic_load_n(&tr_on, __ATOMIC_ACQUIRE) == 1)
+    {
+        trDrain();
+        usleep(TR_FLUSH_MS*1000);
+    }
+    return 0;
+}
+
+// returns 0 on success, -1 if the file can not be written or a trace is running
+int trStart(const char* file)
+{
+    if(tr_on == 1){return -1;}
+    tr_file = fopen(file, "w");
+    if(tr_file == NULL){return -1;}
+    fprintf(tr_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    tr_first = 1;
+    const unsigned int n = __atomic_load_n(&tr_nthreads, __ATOMIC_ACQUIRE);
+    for(unsigned int i = 0; i < n && i < TR_MAX_THREADS; i++)
+    {
+        trbuf* b = __atomic_load_n(&tr_threads[i], __ATOMIC_ACQUIRE);
+        if(b == NULL){continue;}
+        b->named = 0;
+    }
+    __atomic_add_fetch(&tr_session, 1, __ATOMIC_RELAXED);
+    tr_epoch = trNow();
+    __atomic_store_n(&tr_on, 1, __ATOMIC_RELEASE);
+    if(pthread_create(&tr_writer, NULL, trWriter, NULL) != 0)
+    {
+        __atomic_store_n(&tr_on, 0, __ATOMIC_RELEASE);
+        fclose(tr_file);
+        tr_file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void trStop()
+{
+    if(tr_on == 0){return;}
+    __atomic_store_n(&tr_on, 0, __ATOMIC_RELEASE);
+    pthread_join(tr_writer, NULL);
+    trDrain();
+    fprintf(tr_file, "\n]}\n");
+    fclose(tr_file);
+    tr_file = NULL;
+    const unsigned int n = __atomic_load_n(&tr_nthreads, __ATOMIC_ACQUIRE);
+    for(unsigned int i = 0; i < n && i < TR_MAX_THREADS; i++)
+    {
+        trbuf* b = __atomic_load_n(&tr_threads[i], __ATOMIC_ACQUIRE);
+        if(b == NULL){continue;}
+        const uint64_t d = __atomic_load_n(&b->dropped, __ATOMIC_RELAXED);
+        if(d > 0 && __atomic_load_n(&b->session, __ATOMIC_RELAXED) == tr_session)
+            printf("trace: %s dropped %lu spans, its ring was full\n", b->name, (unsigned long)d);
+    }
+}
+
+#endif
@@ -87,7 +87,7 @@ void vMulS(vec* r, const vec v1, const float v2);
 
 static inline float rsqrtss(float f)
 {
-#ifdef NOSSE
+#if defined(NOSSE) || defined(DETERMINISTIC)
     return 1.f/sqrtf(f);
 #else
     return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(f)));
@@ -104,6 +104,78 @@ static inline float sqrtps(float f)
 }
 
 
+#ifdef DETERMINISTIC
+
+// libm trig is not the same on every platform or glibc
+// version, these only use + - * / and sqrt which IEEE 754
+// rounds exactly; build with -ffp-contract=off and without
+// -ffast-math so the compiler keeps the operation order.
+// polynomials from cephes sinf.c and asinf.c
+
+static inline float detsinpoly(const float x)
+{
+    const float z = x*x;
+    return x + x*z*(-1.6666654611e-1f + z*(8.3321608736e-3f + z*-1.9515295891e-4f));
+}
+
+static inline float detcospoly(const float x)
+{
+    const float z = x*x;
+    return 1.f - 0.5f*z + z*z*(4.166664568298827e-2f + z*(-1.388731625493765e-3f + z*2.443315711809948e-5f));
+}
+
+float detsinf(float x)
+{
+    // reduce to [-PI/4, PI/4] in three parts of PI/2
+    const float k = (float)(int)(x * 0.63661977236f + (x < 0.f ? -0.5f : 0.5f));
+    x = ((x - k*1.5703125f) - k*4.837512969970703125e-4f) - k*7.54978995489188216e-8f;
+    switch((int)k & 3)
+    {
+        case 0: return detsinpoly(x);
+        case 1: return detcospoly(x);
+        case 2: return -detsinpoly(x);
+        default: return -detcospoly(x);
+    }
+}
+
+float detcosf(float x)
+{
+    const float k = (float)(int)(x * 0.63661977236f + (x < 0.f ? -0.5f : 0.5f));
+    x = ((x - k*1.5703125f) - k*4.837512969970703125e-4f) - k*7.54978995489188216e-8f;
+    switch((int)k & 3)
+    {
+        case 0: return detcospoly(x);
+        case 1: return -detsinpoly(x);
+        case 2: return -detcospoly(x);
+        default: return detsinpoly(x);
+    }
+}
+
+static inline float detasinpoly(const float x)
+{
+    const float z = x*x;
+    return ((((4.2163199048e-2f*z + 2.4181311049e-2f)*z + 4.5470025998e-2f)*z + 7.4953002686e-2f)*z + 1.6666752422e-1f)*z*x + x;
+}
+
+float detacosf(float x)
+{
+    if(x < -0.5f){return PI - 2.f*detasinpoly(sqrtf(0.5f*(1.f+x)));}
+    if(x > 0.5f){return 2.f*detasinpoly(sqrtf(0.5f*(1.f-x)));}
+    return d2PI - detasinpoly(x);
+}
+
+#define simsinf detsinf
+#define simcosf detcosf
+#define simacosf detacosf
+
+#else
+
+#define simsinf sinf
+#define simcosf cosf
+#define simacosf acosf
+
+#endif
+
 #ifdef SEIR_RAND
 
 // https://www.musicdsp.org/en/latest/Other/273-fast-float-random-numbers.html
@@ -195,11 +267,11 @@ void vRuvBT(vec* v)
     // https://math.stackexchange.com/a/1586185
     // or should I have called this vRuvLR()
     // https://mathworld.wolfram.com/SpherePointPicking.html
-    const float y = acosf(randfc()) - d2PI;
+    const float y = simacosf(randfc()) - d2PI;
     const float p = x2PI * randf();
-    v->x = cosf(y) * cosf(p);
-    v->y = cosf(y) * sinf(p);
-    v->z = sinf(y);
+    v->x = simcosf(y) * simcosf(p);
+    v->y = simcosf(y) * simsinf(p);
+    v->z = simsinf(y);
 }
 
 void vRuvTA(vec* v)
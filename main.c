@@ -9,21 +9,21 @@
     latency with the server. It's not very good.
     I = Toggle Extrapolation, default: off
 
-    To reduce file size the icosphere could be
-    generated on program execution by subdividing
-    a icosahedron and then snapping the points to
-    a unit sphere; and producing an index buffer
-    for each triangle from each subdivision.
+    To reduce file size the icosphere is generated
+    on program execution by subdividing an icosahedron
+    and snapping the points to a sphere, see
+    assets/exo.h. The simulation always runs on the
+    EXO_LEVEL mesh every client shares, argv 5 only caps
+    the detail this machine draws it at.
     
     Get current epoch: date +%s
     Start online game: ./fat <msaa> <future epoch time>
 
     Every player will start at the same epoch and the
     game simulation should run exactly the same across
-    all systems with a small amount of deviation over
-    time due to the accuracy of dt (unavoidable) and
-    the start time accuracy that hangs on the precision
-    of the microtime function.
+    all systems, ticks are a fixed SIM_DT so the only
+    deviation is the start time accuracy that hangs on
+    the precision of the microtime function.
 
     Players only transmit a single registration and then
     their positions as a vec3 in byte format.
@@ -38,18 +38,14 @@
     to utilise http if they want to eventually run in a
     browser, and you skip all the IPv4/IPv6 mess.
 
-    Game is limited to 60 FPS because it seemed like a nice
-    median for all players to keep up with while keeping a
-    smooth experience and not thrashing the http protocol
-    too badly. This could be decoupled from the rendering
-    but there's not a lot of point other than increasing
-    the smoothness of view panning and that's not bad at
-    60 FPS anyway. It's more efficient to keep them coupled.
-    But the latency of the rendering functions could have an
-    impact on the deviation of the simulation over time.
-
-    All players have to stick to the same FPS to minimise the
-    deviance of the simulation over time.
+    The simulation runs at a fixed SIM_HZ tick that is
+    decoupled from rendering; tick n is always simulated
+    at sepoch + n/SIM_HZ seconds of wall time so every
+    client steps through the same sequence of ticks no
+    matter its frame rate, and the render interpolates
+    between the last two ticks. This means the frame rate
+    is free to follow the monitor refresh rate (or argv 3)
+    without the comet field drifting between clients.
 
     gcc main.c glad_gl.c -I inc -Ofast -lglfw -lpthread -lcurl -lm -o fat
 */
@@ -84,6 +80,22 @@ CURL *curl;
 #define SEIR_RAND
 
 #include "inc/esAux2.h"
+#include "inc/ftime.h"
+#include "inc/trace.h"
+#include "inc/glstate.h"
+#include "inc/cull.h"
+#include "inc/cluster.h"
+#include "inc/lod.h"
+void exoBegin();
+void exoEnd();
+void impactBegin();
+void impactEnd();
+#define SIM_EXO_BEGIN() exoBegin()
+#define SIM_EXO_END() exoEnd()
+#define SIM_IMPACT_BEGIN() impactBegin()
+#define SIM_IMPACT_END() impactEnd()
+#include "inc/sim.h"
+#include "inc/replay.h"
 
 #include "inc/res.h"
 
@@ -100,6 +112,11 @@ double t = 0;   // time
 f32 dt = 0;     // delta time
 double fc = 0;  // frame count
 double lfct = 0;// last frame count time
+uint64_t upload_bytes = 0; // exo bytes sent to the gpu since lfct
+uint64_t upload_peak = 0;  // largest single frame upload since lfct
+uint gpu_deform = 0;       // G = toggle craters in the vertex shader
+f32 gpu_impacts[ES_MAX_IMPACTS*4]; // craters since the exo buffers were last uploaded
+uint gpu_numimpacts = 0;
 f32 aspect;
 double rww, ww, rwh, wh, ww2, wh2;
 double uw, uh, uw2, uh2; // normalised pixel dpi
@@ -113,6 +130,10 @@ GLint lightpos_id;
 GLint color_id;
 GLint opacity_id;
 GLint normal_id; // 
+GLint impacts_id;
+GLint numimpacts_id;
+GLint inst0_id;
+GLint inst1_id;
 
 // render state matrices
 mat projection;
@@ -120,11 +141,23 @@ mat view;
 mat model;
 mat modelview;
 
-// models
+// models, the exo and inner shell have a level of detail each to an index buffer
+#define EXO_LODS 4
 ESModel mdlMenger;
 ESModel mdlExo;
 ESModel mdlInner;
+ESModel mdlExoLod[EXO_LODS];
+ESModel mdlInnerLod[EXO_LODS];
 ESModel mdlRock[9];
+ESModel mdlComet[2][9]; // each rock in grey then in red
+ESModel mdlPlayer;
+
+// vertex state, see glstate.h
+gsarray arrMenger;
+gsarray arrExo[EXO_LODS];
+gsarray arrInner[EXO_LODS];
+gsarray arrComet[2][9];
+gsarray arrPlayer;
 
 // camera vars
 #define FAR_DISTANCE 10000.f
@@ -134,36 +167,53 @@ double sens = 0.001;
 f32 xrot = 0.f, yrot = 0.f;
 
 // game vars
-#define GFX_SCALE 0.01f
-#define MOVE_SPEED 0.5f
 #define MIN_UPDATE_TIME_US 10000
 #define UPDATE_TIMEOUT_MS 1000
 uint keystate[8] = {0};
-vec pp = {0.f, 0.f, 0.f};
-vec ppr = {0.f, 0.f, -2.3f};
-uint hits = 0;
-uint popped = 0;
 uint brake = 0;
-uint damage = 0;
 time_t sepoch = 0;
 unsigned short uid = 0;
 uint autoroll = 1;
 
-#define MAX_PLAYERS 31
-float players[MAX_PLAYERS*3] = {0};
+float players[MAX_PLAYERS*3] = {0}; // remote player positions from the netThread
 float players_vel[MAX_PLAYERS*3] = {0};
+float tick_players[MAX_PLAYERS*3];  // players as the simulation sees them this frame
+replay rec; // game log, when one was asked for
+uint64_t exo_span = 0;
+uint64_t impact_span = 0;
 
 uint64_t interp_et = 0;
 float interp_rdt = 0;
 uint interp = 0;
 
-typedef struct
-{
-    vec dir, pos;
-    f32 rot, scale, speed;
-} comet;
-#define NUM_COMETS 64
-comet comets[NUM_COMETS];
+// instanced comets and players on GL 3.3, one draw call per rock model
+#define INST_FLOATS 8 // position, scale, rotation angle, rot, opacity, pad
+uint instanced = 0;
+GLuint inst_buf;
+f32 inst_data[(NUM_COMETS+MAX_PLAYERS)*INST_FLOATS];
+uint inst_first[2][9], inst_count[2][9]; // live then exploding comets, per rock
+
+// culling, the inner shell is never cratered so it hides whatever is behind it
+#define CULL_MARGIN 0.99f   // of the sphere inside every inner shell triangle at every level
+f32 cull_occluder = 0.f;
+uint culling = 1;           // C = toggle
+clview cull_view;
+f32 rock_radius = 0.f;      // of the largest rock model at scale 1
+ecmesh exo_patches[EXO_LODS];   // the exo index buffer in patches, per level of detail
+ecmesh inner_patches[EXO_LODS]; // the same patches over the inner shell
+f32* inner_vertices;        // the exo before simExo(), where the inner shell is
+
+// levels of detail, 0 is the full mesh and each one after has a quarter of the triangles
+#define LOD_PIXELS 8.f      // the coarsest level with triangle edges no longer than this on screen
+uint lod_on = 1;            // L = toggle
+uint lod_floor = 0;         // the finest level drawn, from argv 5
+uint exo_lod = 0;           // this frame
+f32 lod_edge[EXO_LODS];     // mean triangle edge of each level
+f32 exo_radius = 0.f;        // of the inner shell, heights are from there
+
+#define SIM_MAX_TICKS 30 // per frame, the rest carries over to the next frame
+#define CATCHUP_TICKS SIM_HZ  // further behind than this and frames stop until caught up
+#define LATE_JOIN_SECS 3600   // how long after the epoch a game can still be joined
 
 //*************************************
 // utility functions
@@ -194,82 +244,80 @@ void scaleBuffer(GLfloat* b, GLsizeiptr s)
     for(GLsizeiptr i = 0; i < s; i++)
         b[i] *= GFX_SCALE;
 }
-void doExoImpact(vec p, float f)
+void uploadExo()
 {
-    //if(f < 0.003793040058F){return;}
-    const GLsizeiptr s = exo_numvert*3;
-    for(GLsizeiptr i = 0; i < s; i+=3)
+    // send only the vertices moved since the last upload, once per frame
+    if(exo_grid.dirty1 > exo_grid.dirty0)
     {
-        vec v = {exo_vertices[i], exo_vertices[i+1], exo_vertices[i+2]};
-        f32 ds = vDistSq(v, p);
-        if(ds < f*f)
-        {
-            ds = vDist(v, p);
-            vNorm(&v);
-            const f32 sr = f-ds;
-            vMulS(&v, v, sr);
-            if(sr > 0.03f){damage++;}
-            exo_vertices[i]   -= v.x;
-            exo_vertices[i+1] -= v.y;
-            exo_vertices[i+2] -= v.z;
-            exo_colors[i]   -= 0.2f;
-            exo_colors[i+1] -= 0.2f;
-            exo_colors[i+2] -= 0.2f;
-        }
+        const GLintptr o = exo_grid.dirty0 * 3 * sizeof(GLfloat);
+        const GLsizeiptr l = (exo_grid.dirty1 - exo_grid.dirty0) * 3 * sizeof(GLfloat);
+        GSCALLS(2, esRebindRange(GL_ARRAY_BUFFER, &mdlExo.vid, o, exo_vertices, l));
+        GSCALLS(2, esRebindRange(GL_ARRAY_BUFFER, &mdlExo.cid, o, exo_colors, l));
+        egClean(&exo_grid);
+        upload_bytes += l*2;
+        if(l*2 > upload_peak){upload_peak = l*2;}
     }
-    esRebind(GL_ARRAY_BUFFER, &mdlExo.vid, exo_vertices, exo_vertices_size, GL_STATIC_DRAW);
-    esRebind(GL_ARRAY_BUFFER, &mdlExo.cid, exo_colors, exo_colors_size, GL_STATIC_DRAW);
-}
-void randComet(uint i)
-{
-    vRuvBT(&comets[i].pos);
-    vMulS(&comets[i].pos, comets[i].pos, 10.f);
-
-    vec dp;
-    vRuvTA(&dp);
-    vSub(&comets[i].dir, comets[i].pos, dp);
-    vNorm(&comets[i].dir);
-    vInv(&comets[i].dir);
-
-    vec of = comets[i].dir;
-    vInv(&of);
-    vMulS(&of, of, randf()*6.f);
-    vAdd(&comets[i].pos, comets[i].pos, of);
-
-    comets[i].rot = randf()*300.f;
-    comets[i].scale = 0.01f+(randf()*0.07f);
-    comets[i].speed = 0.16f+(randf()*0.08f);
 }
-void randComets()
+void updateExo()
 {
-    for(uint i = 0; i < NUM_COMETS; i++)
-        randComet(i);
+    // the patches new craters reach get new bounds, either way they are drawn, at every level
+    // as the levels share the vertices and so the craters
+    for(uint l = 0; l < EXO_LODS; l++)
+    {
+        if(impact_log_n > IMPACT_LOG_MAX)
+            ecMarkAll(&exo_patches[l]);
+        else
+            for(uint i = 0; i < impact_log_n; i++)
+                ecMark(&exo_patches[l], impact_log[i].p, impact_log[i].f);
+        ecRefresh(&exo_patches[l], exo_vertices);
+    }
+    ftMark(FT_PATCH);
+
+    if(gpu_deform == 0)
+    {
+        uploadExo();
+        impact_log_n = 0;
+        return;
+    }
+
+    // queue the new craters for the vertex shader, when they no longer
+    // fit (or some were missed) the cpu mesh already has them all so
+    // re-upload it and start a new list
+    if(impact_log_n == 0){return;}
+    if(impact_log_n > IMPACT_LOG_MAX || gpu_numimpacts + impact_log_n > ES_MAX_IMPACTS)
+    {
+        uploadExo();
+        gpu_numimpacts = 0;
+    }
+    else
+    {
+        for(uint i = 0; i < impact_log_n; i++)
+        {
+            f32* g = &gpu_impacts[gpu_numimpacts*4];
+            g[0] = impact_log[i].p.x;
+            g[1] = impact_log[i].p.y;
+            g[2] = impact_log[i].p.z;
+            g[3] = impact_log[i].f;
+            gpu_numimpacts++;
+        }
+    }
+    impact_log_n = 0;
 }
-void incrementHits()
+void updateTitle()
 {
-    hits++;
     char title[256];
     const uint max_damage = exo_numvert/2;
-    sprintf(title, "Online Fractal Attack Lite | %u/%u | %.2f%% | %.2f mins", hits, popped, (100.f/(float)max_damage)*(float)damage, (time(0)-sepoch)/60.0);
-    glfwSetWindowTitle(window, title);
-
     if(damage >= max_damage)
-    {
-        for(uint i = 0; i < NUM_COMETS; i++)
-        {
-            comets[i].speed = -1.f;
-            comets[i].rot = 0.f;
-        }
-
         sprintf(title, "Online Fractal Attack Lite | %u/%u | 100%% | %.2f mins | GAME END", hits, popped, (time(0)-sepoch)/60.0);
-        glfwSetWindowTitle(window, title);
-    }
+    else
+        sprintf(title, "Online Fractal Attack Lite | %u/%u | %.2f%% | %.2f mins", hits, popped, (100.f/(float)max_damage)*(float)damage, (time(0)-sepoch)/60.0);
+    glfwSetWindowTitle(window, title);
+    score_dirty = 0;
 }
-
 static size_t cb(void *data, size_t size, size_t nmemb, void *p)
 {
     //if(nmemb > 372){nmemb = 372;}
-    if(nmemb > 11 && nmemb <= 372){memcpy(&players, data, nmemb);}
+    simPlayersIn(players, data, nmemb);
     return 0;
 }
 void curlUpdateGame(const time_t sepoch, const unsigned short uid)
@@ -277,8 +325,9 @@ void curlUpdateGame(const time_t sepoch, const unsigned short uid)
     // might want to add a cache buster to the url
     unsigned char d[12];
     memcpy(&d, (unsigned char*)&ppr, 12);
+    const uint64_t hc = __atomic_load_n(&hash_check, __ATOMIC_RELAXED);
     char url[256];
-    sprintf(url, "https://fractalattack.repl.co/?r=%lu&u=%hu&p=%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X", sepoch, uid, d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], d[8], d[9], d[10], d[11]);
+    sprintf(url, "https://fractalattack.repl.co/?r=%lu&u=%hu&p=%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X%%%02X&t=%u&h=%08X", sepoch, uid, d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], d[8], d[9], d[10], d[11], (uint)(hc >> 32), (uint)(hc & 0xFFFFFFFF));
     //printf("%s\n", url);
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, UPDATE_TIMEOUT_MS);
@@ -291,7 +340,8 @@ void curlRegisterGame(const time_t sepoch, const unsigned short uid)
     char url[256];
     sprintf(url, "https://fractalattack.repl.co/?r=%lu&u=%hu", sepoch, uid);
     curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, time(0)-sepoch);
+    const long wait = sepoch-time(0); // until the epoch, a late join gets a few seconds
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, wait > 3 ? wait : 3);
 
     FILE *devnull = fopen("/dev/null", "w+");
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, devnull);
@@ -300,10 +350,11 @@ void curlRegisterGame(const time_t sepoch, const unsigned short uid)
 }
 void *netThread(void *arg)
 {
+    trThread("net");
     float prevel[MAX_PLAYERS*3] = {0};
     while(1)
     {
-        if(comets[0].speed == -1.f)
+        if(comets.speed[0] == -1.f)
         {
             printf("netThread: quit, end game.\n");
             return 0;
@@ -320,7 +371,9 @@ void *netThread(void *arg)
             }
         }
         const uint64_t last_update = microtime();
+        const uint64_t span = trBegin();
         curlUpdateGame(sepoch, uid);
+        trEnd("curlUpdateGame", span);
         const uint64_t this_time = microtime();
         const uint64_t delta_time = this_time-last_update;
         if(interp == 1)
@@ -356,6 +409,239 @@ void *netThread(void *arg)
     }
 }
 
+//*************************************
+// simulation
+//*************************************
+void readInput(siminput* in)
+{
+    // W,S along the view, A,D across it, SPACE,SHIFT up and down
+    memset(in, 0, sizeof(siminput));
+    if(keystate[2] == 1)
+        in->thrust[0] = (vec){view.m[0][2], view.m[1][2], view.m[2][2]};
+    else if(keystate[3] == 1)
+        in->thrust[0] = (vec){-view.m[0][2], -view.m[1][2], -view.m[2][2]};
+
+    if(keystate[0] == 1)
+        in->thrust[1] = (vec){view.m[0][0], view.m[1][0], view.m[2][0]};
+    else if(keystate[1] == 1)
+        in->thrust[1] = (vec){-view.m[0][0], -view.m[1][0], -view.m[2][0]};
+
+    if(keystate[4] == 1)
+        in->thrust[2] = (vec){-view.m[0][1], -view.m[1][1], -view.m[2][1]};
+    else if(keystate[5] == 1)
+        in->thrust[2] = (vec){view.m[0][1], view.m[1][1], view.m[2][1]};
+
+    in->brake = brake;
+    in->players = tick_players;
+}
+
+// the crater pass gets its own frame time and trace span
+void exoBegin()
+{
+    ftMark(FT_SIM);
+    exo_span = trBegin();
+}
+void exoEnd()
+{
+    trEnd("applyImpacts", exo_span);
+    ftMark(FT_EXO);
+}
+
+// and each crater in it a span of its own, only while tracing
+void impactBegin()
+{
+    impact_span = tr_on == 1 ? trBegin() : 0;
+}
+void impactEnd()
+{
+    if(impact_span != 0){trEnd("doExoImpact", impact_span);}
+}
+
+void tick(const siminput* in)
+{
+    if(rec.f != NULL)
+    {
+        unsigned char keys = 0;
+        for(uint i = 0; i < 8; i++)
+            keys |= (keystate[i] == 1) << i;
+        rpInput(&rec, in, keys);
+    }
+    simTick(in);
+    if(rec.f != NULL)
+        rpTicked(&rec);
+}
+
+uint64_t epochTime()
+{
+    // microseconds since sepoch, 0 until then
+    const uint64_t e = (uint64_t)sepoch*1000000;
+    const uint64_t now = microtime();
+    return now > e ? now - e : 0;
+}
+uint64_t targetTick()
+{
+    // every client runs tick n at sepoch + n/SIM_HZ seconds
+    return epochTime() * SIM_HZ / 1000000;
+}
+void catchUp()
+{
+    // a late join or a long stall, skip the frames and run the
+    // simulation flat out until the frames can take it from here;
+    // where the others are now says nothing of where they were in
+    // the ticks being replayed, so those run without them
+    char strts[16], title[256];
+    static f32 no_players[MAX_PLAYERS*3] = {0};
+    siminput in;
+    memset(&in, 0, sizeof(siminput));
+    in.players = no_players;
+    const uint64_t span = trBegin();
+    const uint64_t st = microtime();
+    const uint64_t t0 = sim_tick;
+    uint64_t target = targetTick();
+    while(sim_tick + SIM_MAX_TICKS < target && !glfwWindowShouldClose(window))
+    {
+        for(uint i = 0; i < SIM_HZ && sim_tick < target; i++)
+            tick(&in);
+
+        // keep the window responsive
+        sprintf(title, "Catching up... %.1f seconds behind.", (double)(target - sim_tick) / SIM_HZ);
+        glfwSetWindowTitle(window, title);
+        glfwPollEvents();
+        target = targetTick();
+    }
+    const double secs = (double)(microtime() - st) * 0.000001;
+    trEnd("catchUp", span);
+    timestamp(&strts[0]);
+    printf("[%s] Caught up %lu ticks (%.1f s of game time) in %.3f s, x%.0f realtime.\n", strts,
+        (unsigned long)(sim_tick - t0), (double)(sim_tick - t0) / SIM_HZ, secs, (double)(sim_tick - t0) / SIM_HZ / secs);
+    score_dirty = 1;
+}
+
+//*************************************
+// instanced rocks
+//*************************************
+// CL_VISIBLE or why not, counted for the frame timing
+int cullSphere(const vec p, const f32 r)
+{
+    if(culling == 0){ftCount(FTC_SUBMITTED, 1); return CL_VISIBLE;}
+    const int v = clVisible(&cull_view, p, r);
+    if(v == CL_VISIBLE)
+        ftCount(FTC_SUBMITTED, 1);
+    else
+        ftCount(v == CL_FRUSTUM ? FTC_CULL_FRUSTUM : FTC_CULL_PLANET, 1);
+    return v;
+}
+
+f32 modelRadius(const GLfloat* v, const GLsizeiptr numvert)
+{
+    f32 r = 0.f;
+    for(GLsizeiptr i = 0; i < numvert*3; i+=3)
+    {
+        const f32 l = vMod((vec){v[i], v[i+1], v[i+2]});
+        if(l > r){r = l;}
+    }
+    return r;
+}
+
+// the patches of a shell that can be seen, of those in only or all with NULL, the index buffer has to be bound
+void drawShell(ecmesh* m, const unsigned char* only)
+{
+    if(culling == 0)
+    {
+        GSCALL(glDrawElements(GL_TRIANGLES, m->numind, GL_UNSIGNED_INT, 0));
+        ftCount(FTC_EXO_TRIS, m->numind / 3);
+        return;
+    }
+    ftCount(FTC_EXO_TRIS, ecSelect(m, &cull_view, only));
+    gs_calls += ecDraw(m);
+}
+
+// the coarsest level whose triangles are at most LOD_PIXELS across from the eye
+uint lodPick(const vec eye)
+{
+    if(lod_on == 0){return lod_floor;}
+    const f32 h = vMod(eye) - exo_radius;
+    if(h <= 0.f){return lod_floor;}
+    const f32 ppu = (f32)winh / (2.f * tanf(30.f * DEG2RAD) * h); // pixels a unit at the surface below, 60 degree fov
+    uint l = lod_floor;
+    while(l+1 < EXO_LODS && lod_edge[l+1] * ppu <= LOD_PIXELS){l++;}
+    return l;
+}
+
+uint cometRock(const uint i)
+{
+    // 7 comets to each of the 9 rock models, the rest on the last
+    static const f32 rrcs = 1.f / (f32)(NUM_COMETS / 9);
+    uint nbs = i * rrcs;
+    if(nbs > 8){nbs = 8;}
+    return nbs;
+}
+
+// fills inst_data with every comet, live ones first then exploding ones, grouped by rock
+uint instanceComets(const f32 alpha)
+{
+    uint n = 0;
+    memset(inst_count, 0, sizeof(inst_count));
+    for(uint pass = 0; pass < 2; pass++)
+    {
+        for(uint i = 0; i < NUM_COMETS; i++)
+        {
+            if((comets.speed[i] == 0.f) != pass){continue;}
+
+            // between the last two ticks, as the single draw path
+            const vec p = (vec){comets.qx[i] + (comets.px[i]-comets.qx[i])*alpha, comets.qy[i] + (comets.py[i]-comets.qy[i])*alpha, comets.qz[i] + (comets.pz[i]-comets.qz[i])*alpha};
+            if(cullSphere(p, comets.scale[i]*rock_radius) != CL_VISIBLE){continue;}
+
+            const uint r = cometRock(i);
+            if(inst_count[pass][r] == 0){inst_first[pass][r] = n;}
+            inst_count[pass][r]++;
+            f32* d = &inst_data[n*INST_FLOATS];
+            d[0] = p.x;
+            d[1] = p.y;
+            d[2] = p.z;
+            d[3] = comets.scale[i];
+            d[4] = comets.rot[i]*0.01f*t;
+            d[5] = comets.rot[i];
+            d[6] = pass == 1 ? comets.dx[i] : 1.f;
+            d[7] = 0.f;
+            n++;
+        }
+    }
+    return n;
+}
+
+// draws count instances of one rock model starting at instance first
+void drawInstances(gsarray* a, const ESModel* m, const uint first, const uint count)
+{
+    gsModel(a, m, position_id, normal_id, color_id);
+
+    // no base instance before GL 4.2, offset the instance arrays instead
+    const GLsizei stride = INST_FLOATS*sizeof(f32);
+    gsAttrib(inst0_id, inst_buf, 4, stride, first*stride, 1);
+    gsAttrib(inst1_id, inst_buf, 4, stride, first*stride + 4*sizeof(f32), 1);
+    GSCALL(glDrawElementsInstanced(GL_TRIANGLES, rock1_numind, GL_UNSIGNED_BYTE, 0, count));
+}
+
+// players sit after the comets in inst_data
+void drawInstanced(const uint ni, const uint np)
+{
+    GSCALL(glBindBuffer(GL_ARRAY_BUFFER, inst_buf));
+    GSCALL(glBufferData(GL_ARRAY_BUFFER, (ni+np)*INST_FLOATS*sizeof(f32), inst_data, GL_STREAM_DRAW));
+
+    for(uint r = 0; r < 9; r++)
+        if(inst_count[0][r] > 0)
+            drawInstances(&arrComet[0][r], &mdlComet[0][r], inst_first[0][r], inst_count[0][r]);
+
+    gsBlend(1);
+    for(uint r = 0; r < 9; r++)
+        if(inst_count[1][r] > 0)
+            drawInstances(&arrComet[1][r], &mdlComet[1][r], inst_first[1][r], inst_count[1][r]);
+    gsBlend(0);
+
+    if(np > 0)
+        drawInstances(&arrPlayer, &mdlPlayer, ni, np);
+}
+
 //*************************************
 // update & render
 //*************************************
@@ -370,62 +656,44 @@ void main_loop()
     lt = t;
 
 //*************************************
-// keystates
+// simulation
 //*************************************
 
-    static f32 zrot = 0.f;
-
-    if(keystate[2] == 1) // W
-    {
-        vec vdc = (vec){view.m[0][2], view.m[1][2], view.m[2][2]};
-        vec m;
-        vMulS(&m, vdc, MOVE_SPEED * dt);
-        vAdd(&pp, pp, m);
-    }
-    else if(keystate[3] == 1) // S
+    if(targetTick() > sim_tick + CATCHUP_TICKS)
     {
-        vec vdc = (vec){view.m[0][2], view.m[1][2], view.m[2][2]};
-        vec m;
-        vMulS(&m, vdc, MOVE_SPEED * dt);
-        vSub(&pp, pp, m);
+        catchUp();
+        t = glfwGetTime(); // the catch up is not frame time
+        lt = t;
+        dt = 0.f;
     }
 
-    if(keystate[0] == 1) // A
+    // every client runs tick n at sepoch + n/SIM_HZ seconds
+    const uint64_t us = epochTime() * SIM_HZ;
+    const uint64_t target = us / 1000000;
+    uint ticks = 0;
+    siminput in;
+    readInput(&in);
+    memcpy(tick_players, players, sizeof(players)); // the netThread may write mid frame
+    while(sim_tick < target && ticks < SIM_MAX_TICKS)
     {
-        vec vdc = (vec){view.m[0][0], view.m[1][0], view.m[2][0]};
-        vec m;
-        vMulS(&m, vdc, MOVE_SPEED * dt);
-        vAdd(&pp, pp, m);
-    }
-    else if(keystate[1] == 1) // D
-    {
-        vec vdc = (vec){view.m[0][0], view.m[1][0], view.m[2][0]};
-        vec m;
-        vMulS(&m, vdc, MOVE_SPEED * dt);
-        vSub(&pp, pp, m);
+        tick(&in);
+        ticks++;
     }
 
-    if(keystate[4] == 1) // SPACE
-    {
-        vec vdc = (vec){view.m[0][1], view.m[1][1], view.m[2][1]};
-        vec m;
-        vMulS(&m, vdc, MOVE_SPEED * dt);
-        vSub(&pp, pp, m);
-    }
-    else if(keystate[5] == 1) // SHIFT
-    {
-        vec vdc = (vec){view.m[0][1], view.m[1][1], view.m[2][1]};
-        vec m;
-        vMulS(&m, vdc, MOVE_SPEED * dt);
-        vAdd(&pp, pp, m);
-    }
+    // how far between the last two ticks this frame is
+    f32 alpha = 1.f;
+    if(sim_tick == target)
+        alpha = (f32)(us % 1000000) * 0.000001f;
 
-    if(brake == 1)
-        vMulS(&pp, pp, 0.99f*(1.f-dt));
+    if(score_dirty == 1)
+        updateTitle();
+    ftMark(FT_SIM);
 
-    vec ppi = pp;
-    vMulS(&ppi, ppi, dt);
-    vAdd(&ppr, ppr, ppi);
+//*************************************
+// camera
+//*************************************
+
+    static f32 zrot = 0.f;
 
     const f32 pmod = vMod(ppr);
     if(autoroll == 1 && pmod < 2.f) // self-righting
@@ -477,20 +745,6 @@ void main_loop()
                 zrot = 0.f;
         }
     }
-    if(pmod < 1.13f) // exo collision
-    {
-        const f32 hf = vMod(pp)*10.f;
-        vec n = ppr;
-        vNorm(&n);
-         vReflect(&pp, pp, (vec){-n.x, -n.y, -n.z}); // better if I don't normalise pp
-         vMulS(&pp, pp, 0.3f);
-        vMulS(&n, n, 1.13f - pmod);
-        vAdd(&ppr, ppr, n);
-    }
-
-//*************************************
-// camera
-//*************************************
 
     // mouse delta to rot
     f32 xrot = 0.f, yrot = 0.f;
@@ -565,251 +819,144 @@ void main_loop()
         0.f, 0.f, 0.f, view.m[3][3]
     };
 
-    // translate
-    mTranslate(&view, ppr.x, ppr.y, ppr.z);
+    // translate, between the last two ticks
+    const vec ip = (vec){ppr_prev.x + (ppr.x-ppr_prev.x)*alpha, ppr_prev.y + (ppr.y-ppr_prev.y)*alpha, ppr_prev.z + (ppr.z-ppr_prev.z)*alpha};
+    mTranslate(&view, ip.x, ip.y, ip.z);
 
     static f32 ft = 0.f;
     ft += dt*0.03f;
     lightpos.x = sinf(ft) * 6.3f;
     lightpos.y = cosf(ft) * 6.3f;
     lightpos.z = sinf(ft) * 6.3f;
+    ftMark(FT_CAMERA);
 
 //*************************************
 // render
 //*************************************
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GSCALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
     ///
     
-    shadeLambert2(&position_id, &projection_id, &modelview_id, &lightpos_id, &color_id, &opacity_id);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
-    glUniform3f(lightpos_id, lightpos.x, lightpos.y, lightpos.z);
-    glUniform1f(opacity_id, 1.f);
+    ftMark(FT_DRAW);
+    updateExo();
+    ftMark(FT_UPLOAD);
+
+    if(gpu_deform == 1)
+    {
+        GSCALL(shadeLambert2C(&position_id, &projection_id, &modelview_id, &lightpos_id, &color_id, &opacity_id, &impacts_id, &numimpacts_id));
+        GSCALL(glUniform4fv(impacts_id, gpu_numimpacts, gpu_impacts));
+        GSCALL(glUniform1i(numimpacts_id, gpu_numimpacts));
+    }
+    else
+        GSCALL(shadeLambert2(&position_id, &projection_id, &modelview_id, &lightpos_id, &color_id, &opacity_id));
+    GSCALL(glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]));
+    GSCALL(glUniform3f(lightpos_id, lightpos.x, lightpos.y, lightpos.z));
+    GSCALL(glUniform1f(opacity_id, 1.f));
     
     ///
 
-    glBindBuffer(GL_ARRAY_BUFFER, mdlExo.vid);
-    glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(position_id);
-
-    glBindBuffer(GL_ARRAY_BUFFER, mdlExo.cid);
-    glVertexAttribPointer(color_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(color_id);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mdlExo.iid);
-
-    glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (GLfloat*) &view.m[0][0]);
-    glDrawElements(GL_TRIANGLES, exo_numind, GL_UNSIGNED_INT, 0);
+    // everything culls against what can be seen from the eye at -ip
+    mat clip;
+    mMul(&clip, &view, &projection);
+    clSetup(&cull_view, &clip, (vec){-ip.x, -ip.y, -ip.z}, cull_occluder);
 
-    /// the inner wont draw now if occluded by the exo due to depth buffer
+    exo_lod = lodPick(cull_view.eye);
+    gsModel(&arrExo[exo_lod], &mdlExoLod[exo_lod], position_id, -1, color_id);
+    GSCALL(glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (GLfloat*) &view.m[0][0]));
+    drawShell(&exo_patches[exo_lod], NULL);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mdlInner.vid);
-    glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(position_id);
+    /// the inner only shows through the patches of the exo craters broke through
 
-    glBindBuffer(GL_ARRAY_BUFFER, mdlInner.cid);
-    glVertexAttribPointer(color_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(color_id);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mdlExo.iid);
+    if(culling == 0 || exo_patches[exo_lod].nbreached > 0)
+    {
+        if(gpu_deform == 1) // the inner shell is never cratered
+            GSCALL(glUniform1i(numimpacts_id, 0));
 
-    glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (GLfloat*) &view.m[0][0]);
-    glDrawElements(GL_TRIANGLES, exo_numind, GL_UNSIGNED_INT, 0);
+        gsModel(&arrInner[exo_lod], &mdlInnerLod[exo_lod], position_id, -1, color_id);
+        drawShell(&inner_patches[exo_lod], exo_patches[exo_lod].breached);
+    }
 
     ///
 
     // lambert
-    shadeLambert(&position_id, &projection_id, &modelview_id, &lightpos_id, &color_id, &opacity_id);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
-    glUniform3f(lightpos_id, 0.f, 0.f, 0.f);
-    glUniform1f(opacity_id, 1.f);
+    GSCALL(shadeLambert(&position_id, &projection_id, &modelview_id, &lightpos_id, &color_id, &opacity_id));
+    GSCALL(glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]));
+    GSCALL(glUniform3f(lightpos_id, 0.f, 0.f, 0.f));
+    GSCALL(glUniform1f(opacity_id, 1.f));
 
     // bind menger
-    glBindBuffer(GL_ARRAY_BUFFER, mdlMenger.vid);
-    glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(position_id);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mdlMenger.iid);
+    gsModel(&arrMenger, &mdlMenger, position_id, -1, -1);
 
     // "light source" dummy object
     mIdent(&model);
     mTranslate(&model, lightpos.x, lightpos.y, lightpos.z);
     mScale(&model, 3.4f, 3.4f, 3.4f);
-    glUniform3f(color_id, 1.f, 1.f, 0.f);
+    GSCALL(glUniform3f(color_id, 1.f, 1.f, 0.f));
     mMul(&modelview, &model, &view);
-    glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &modelview.m[0][0]);
-    glDrawElements(GL_TRIANGLES, ncube_numind, GL_UNSIGNED_INT, 0);
+    GSCALL(glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &modelview.m[0][0]));
+    GSCALL(glDrawElements(GL_TRIANGLES, ncube_numind, GL_UNSIGNED_INT, 0));
 
     // lambert
-    shadeLambert3(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &opacity_id);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
-    glUniform3f(lightpos_id, 0.f, 0.f, 0.f);
+    if(instanced == 1)
+        GSCALL(shadeLambert3I(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &inst0_id, &inst1_id));
+    else
+        GSCALL(shadeLambert3(&position_id, &projection_id, &modelview_id, &lightpos_id, &normal_id, &color_id, &opacity_id));
+    GSCALL(glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]));
+    GSCALL(glUniform3f(lightpos_id, 0.f, 0.f, 0.f));
 
     // comets
-    static const uint rcs = NUM_COMETS / 9;
-    static const f32 rrcs = 1.f / (f32)rcs;
-    int bindstate = -1;
-    int cbs = -1;
-    for(uint i = 0; i < NUM_COMETS; i++)
+    uint ni = 0, np = 0;
+    if(instanced == 1)
     {
-        // simulation
-        if(comets[i].speed == 0.f) // explode
-        {
-            if(cbs != 0)
-            {
-                glBindBuffer(GL_ARRAY_BUFFER, mdlRock[1].cid);
-                glVertexAttribPointer(color_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-                glEnableVertexAttribArray(color_id);
-                cbs = 0;
-            }
-
-            comets[i].dir.x -= 0.3f*dt;
-            comets[i].scale -= 0.03f*dt;
-            if(comets[i].dir.x <= 0.f || comets[i].scale <= 0.f)
-            {
-                randComet(i);
-                continue;
-            }
-            glUniform1f(opacity_id, comets[i].dir.x);
-        }
-        else if(comets[i].speed != -1.f) // detect impacts
-        {
-            // increment position
-            const f32 pi = comets[i].speed*dt;
-            vAdd(&comets[i].pos, comets[i].pos, (vec){comets[i].dir.x*pi,  comets[i].dir.y*pi, comets[i].dir.z*pi});
-
-            // planet impact
-            if(vMod(comets[i].pos) < 1.14f)
-            {
-                doExoImpact((vec){comets[i].pos.x, comets[i].pos.y, comets[i].pos.z}, (comets[i].scale+(comets[i].speed*0.1f))*1.2f);
-
-                vec fwd;
-                vMulS(&fwd, comets[i].dir, 0.03f);
-                vAdd(&comets[i].pos, comets[i].pos, fwd);
-                comets[i].speed = 0.f;
-                comets[i].dir.x = 1.f;
-                comets[i].scale *= 2.f;
-
-                incrementHits();
-                continue;
-            }
+        GSCALL(glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &view.m[0][0]));
+        ni = instanceComets(alpha);
+    }
+    else for(uint i = 0; i < NUM_COMETS; i++)
+    {
+        const vec p = (vec){comets.qx[i] + (comets.px[i]-comets.qx[i])*alpha, comets.qy[i] + (comets.py[i]-comets.qy[i])*alpha, comets.qz[i] + (comets.pz[i]-comets.qz[i])*alpha};
+        if(cullSphere(p, comets.scale[i]*rock_radius) != CL_VISIBLE){continue;}
 
-            // player impact
-            const f32 cd = vDistSq((vec){-ppr.x, -ppr.y, -ppr.z}, comets[i].pos);
-            const f32 cs = comets[i].scale+0.06f;
-            if(cd < cs*cs)
-            {
-                popped++;
-                char title[256];
-                const uint max_damage = exo_numvert/2;
-                sprintf(title, "Online Fractal Attack Lite | %u/%u | %.2f%% | %.2f mins", hits, popped, (100.f/(float)max_damage)*(float)damage, (time(0)-sepoch)/60.0);
-                glfwSetWindowTitle(window, title);
-                comets[i].speed = 0.f;
-                comets[i].dir.x = 1.f;
-                //comets[i].scale *= 2.f;
-            }
+        // grey or red, one of the 9 rock models
+        const uint explode = comets.speed[i] == 0.f;
+        const uint nbs = cometRock(i);
+        gsModel(&arrComet[explode][nbs], &mdlComet[explode][nbs], position_id, normal_id, color_id);
+        if(explode == 1)
+            GSCALL(glUniform1f(opacity_id, comets.dx[i]));
 
-            // comet impact
-            for(uint k = 0; k < NUM_COMETS; k++)
-            {
-                if(k == i){continue;}
-                const f32 cd = vDistSq(comets[i].pos, comets[k].pos);
-                if(cd < comets[i].scale*comets[i].scale)
-                {
-                    comets[i].speed = 0.f;
-                    comets[i].dir.x = 1.f;
-                    comets[k].speed = 0.f;
-                    comets[k].dir.x = 1.f;
-                }
-            }
-
-            // flip to grey if red
-            if(cbs != 1)
-            {
-                glBindBuffer(GL_ARRAY_BUFFER, mdlRock[0].cid);
-                glVertexAttribPointer(color_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-                glEnableVertexAttribArray(color_id);
-                cbs = 1;
-            }
-        }
-        else
-        {
-            if(cbs != 1)
-            {
-                glBindBuffer(GL_ARRAY_BUFFER, mdlRock[0].cid);
-                glVertexAttribPointer(color_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-                glEnableVertexAttribArray(color_id);
-                cbs = 1;
-            }
-        }
-
-        // translate comet
+        // translate comet, between the last two ticks
         mIdent(&model);
-        mTranslate(&model, comets[i].pos.x, comets[i].pos.y, comets[i].pos.z);
+        mTranslate(&model, p.x, p.y, p.z);
 
         // rotate comet
-        const f32 mag = comets[i].rot*0.01f*t;
-        if(comets[i].rot < 100.f)
+        const f32 mag = comets.rot[i]*0.01f*t;
+        if(comets.rot[i] < 100.f)
             mRotY(&model, mag);
-        if(comets[i].rot < 200.f)
+        if(comets.rot[i] < 200.f)
             mRotZ(&model, mag);
-        if(comets[i].rot < 300.f)
+        if(comets.rot[i] < 300.f)
             mRotX(&model, mag);
         
         // scale comet
-        mScale(&model, comets[i].scale, comets[i].scale, comets[i].scale);
+        mScale(&model, comets.scale[i], comets.scale[i], comets.scale[i]);
 
         // make modelview
         mMul(&modelview, &model, &view);
-        glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &modelview.m[0][0]);
-
-        // bind one of the 8 rock models
-        uint nbs = i * rrcs;
-        if(nbs > 8){nbs = 8;}
-        if(nbs != bindstate)
-        {
-            glBindBuffer(GL_ARRAY_BUFFER, mdlRock[nbs].vid);
-            glVertexAttribPointer(position_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-            glEnableVertexAttribArray(position_id);
-
-            glBindBuffer(GL_ARRAY_BUFFER, mdlRock[nbs].nid);
-            glVertexAttribPointer(normal_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-            glEnableVertexAttribArray(normal_id);
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mdlRock[nbs].iid);
-            bindstate = nbs;
-        }
+        GSCALL(glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &modelview.m[0][0]));
 
         // draw it
-        if(comets[i].speed == 0.f)
-        {
-            glEnable(GL_BLEND);
-            glDrawElements(GL_TRIANGLES, rock1_numind, GL_UNSIGNED_BYTE, 0);
-            glDisable(GL_BLEND);
-        }
-        else
-            glDrawElements(GL_TRIANGLES, rock1_numind, GL_UNSIGNED_BYTE, 0);
+        gsBlend(explode);
+        GSCALL(glDrawElements(GL_TRIANGLES, rock1_numind, GL_UNSIGNED_BYTE, 0));
     }
+    gsBlend(0);
 
     // players
-    glBindBuffer(GL_ARRAY_BUFFER, mdlRock[2].cid);
-    glVertexAttribPointer(color_id, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(color_id);
+    if(instanced == 0)
+        gsModel(&arrPlayer, &mdlPlayer, position_id, normal_id, color_id);
     for(uint i = 0; i < MAX_PLAYERS; i++)
     {
         const uint j = i*3;
         if(players[j] != 0.f || players[j+1] != 0.f || players[j+2] != 0.f)
         {
-            for(uint k = 0; k < NUM_COMETS; k++)
-            {
-                const f32 cd = vDistSq((vec){-players[j], -players[j+1], -players[j+2]}, comets[k].pos);
-                const f32 cs = comets[i].scale+0.06f;
-                if(cd < cs*cs)
-                {
-                    comets[k].speed = 0.f;
-                    comets[k].dir.x = 1.f;
-                }
-            }
-
             if(interp == 1 && ((players_vel[j]+players_vel[j+1]+players_vel[j+2] != 0.f) && microtime() < interp_et))
             {
                 float s = 1.f - (interp_rdt * (float)(interp_et - microtime()));
@@ -820,18 +967,40 @@ void main_loop()
                 players[j+2] += players_vel[j+2]*s;
                 //printf("[%u] (%f) %f %f %f\n", i, s, players_vel[j], players_vel[j+1], players_vel[j+2]);
             }
+            if(cullSphere((vec){-players[j], -players[j+1], -players[j+2]}, 0.01f*rock_radius) != CL_VISIBLE){continue;}
+
+            if(instanced == 1)
+            {
+                f32* d = &inst_data[(ni+np)*INST_FLOATS];
+                d[0] = -players[j];
+                d[1] = -players[j+1];
+                d[2] = -players[j+2];
+                d[3] = 0.01f;
+                d[4] = 0.f;
+                d[5] = 300.f; // no rotation
+                d[6] = 1.f;
+                d[7] = 0.f;
+                np++;
+                continue;
+            }
             
             mIdent(&model);
             mTranslate(&model, -players[j], -players[j+1], -players[j+2]);
             mScale(&model, 0.01f, 0.01f, 0.01f);
             mMul(&modelview, &model, &view);
-            glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &modelview.m[0][0]);
-            glDrawElements(GL_TRIANGLES, rock1_numind, GL_UNSIGNED_BYTE, 0);
+            GSCALL(glUniformMatrix4fv(modelview_id, 1, GL_FALSE, (f32*) &modelview.m[0][0]));
+            GSCALL(glDrawElements(GL_TRIANGLES, rock1_numind, GL_UNSIGNED_BYTE, 0));
         }
     }
+    if(instanced == 1)
+        drawInstanced(ni, np);
     
     // swap
+    ftMark(FT_DRAW);
+    const uint64_t span = trBegin();
     glfwSwapBuffers(window);
+    trEnd("glfwSwapBuffers", span);
+    ftMark(FT_SWAP);
 }
 
 //*************************************
@@ -842,7 +1011,7 @@ void window_size_callback(GLFWwindow* window, int width, int height)
     winw = width;
     winh = height;
 
-    glViewport(0, 0, winw, winh);
+    GSCALL(glViewport(0, 0, winw, winh));
     aspect = (f32)winw / (f32)winh;
     ww = (double)winw;
     wh = (double)winh;
@@ -857,7 +1026,7 @@ void window_size_callback(GLFWwindow* window, int width, int height)
 
     mIdent(&projection);
     mPerspective(&projection, 60.0f, aspect, 0.01f, FAR_DISTANCE);
-    glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]);
+    GSCALL(glUniformMatrix4fv(projection_id, 1, GL_FALSE, (GLfloat*) &projection.m[0][0]));
 }
 
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -880,8 +1049,35 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
                 char strts[16];
                 timestamp(&strts[0]);
                 printf("[%s] FPS: %g\n", strts, fc/(t-lfct));
+                printf("[%s] Exo upload: %.0f bytes/frame avg, %lu bytes peak\n", strts, (double)upload_bytes/fc, upload_peak);
                 lfct = t;
                 fc = 0;
+                upload_bytes = 0;
+                upload_peak = 0;
+            }
+        }
+        else if(key == GLFW_KEY_P)
+        {
+            ftDump();
+            gsDump();
+        }
+        else if(key == GLFW_KEY_T)
+        {
+            char strts[16];
+            timestamp(&strts[0]);
+            if(tr_on == 1)
+            {
+                trStop();
+                printf("[%s] Trace stopped.\n", strts);
+            }
+            else
+            {
+                char file[64];
+                sprintf(file, "fa-trace-%lu.json", time(0));
+                if(trStart(file) < 0)
+                    printf("[%s] Could not write %s\n", strts, file);
+                else
+                    printf("[%s] Tracing to %s, T again to stop.\n", strts, file);
             }
         }
         else if(key == GLFW_KEY_ESCAPE)
@@ -921,6 +1117,33 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
             else
                 printf("Player extrapolation off.\n");
         }
+        else if(key == GLFW_KEY_G)
+        {
+            // both ways the cpu mesh is current, only the gpu copy is behind
+            gpu_deform = 1 - gpu_deform;
+            gpu_numimpacts = 0;
+            uploadExo();
+            if(gpu_deform == 1)
+                printf("Exo craters in the vertex shader.\n");
+            else
+                printf("Exo craters uploaded from the cpu.\n");
+        }
+        else if(key == GLFW_KEY_C)
+        {
+            culling = 1 - culling;
+            if(culling == 1)
+                printf("Culling on.\n");
+            else
+                printf("Culling off.\n");
+        }
+        else if(key == GLFW_KEY_L)
+        {
+            lod_on = 1 - lod_on;
+            if(lod_on == 1)
+                printf("Exo level of detail on.\n");
+            else
+                printf("Exo level of detail off.\n");
+        }
         else if(key == GLFW_KEY_R)
         {
             autoroll = 1 - autoroll;
@@ -970,6 +1193,7 @@ int main(int argc, char** argv)
 {
     // gen client UID
     uid = urand16();
+    trThread("render");
 
     // epoch
     sepoch = time(0);
@@ -981,9 +1205,14 @@ int main(int argc, char** argv)
     printf("----\n");
     printf("James William Fletcher (github.com/mrbid)\n");
     printf("----\n");
-    printf("Argv(2): start epoch, msaa 0-16\n");
+    printf("Argv(5): start epoch, msaa 0-16, max fps (0 = unlimited), game log file (- = none), exo detail %u-%u\n", EXO_LEVEL-(EXO_LODS-1), EXO_LEVEL);
     printf("F = FPS to console.\n");
+    printf("P = Frame timing percentiles and GL calls per frame to console.\n");
+    printf("C = Toggle comet, player and exo patch culling.\n");
+    printf("T = Start/stop a chrome://tracing trace of the frames and the network.\n");
     printf("I = Toggle player lag extrapolation.\n");
+    printf("G = Toggle exo craters in the vertex shader.\n");
+    printf("L = Toggle exo level of detail.\n");
     printf("R = Toggle auto-tilt around planet.\n");
     printf("W, A, S, D, Q, E, SPACE, LEFT SHIFT\n");
     printf("L-CTRL / Right Click to Brake.\n");
@@ -994,11 +1223,14 @@ int main(int argc, char** argv)
     if(argc >= 2)
     {
         sepoch = atoll(argv[1]);
-        if(sepoch != 0 && sepoch-time(0) < 3)
+        if(sepoch == 0){sepoch = time(0);} // 0 = start now, tick 0 is this second
+        if(time(0)-sepoch > LATE_JOIN_SECS)
         {
-            printf("suggested epoch: %lu\n----\nYour epoch should be at minimum 3 seconds into the future.\n", time(0)+16);
+            printf("suggested epoch: %lu\n----\nYour epoch can be at most %u seconds in the past.\n", time(0)+16, LATE_JOIN_SECS);
             return 0;
         }
+        if(sepoch < time(0))
+            printf("late join, the game started %lu seconds ago and will catch up.\n", time(0)-sepoch);
     }
 
     printf("start epoch:   %lu\n", sepoch);
@@ -1009,6 +1241,31 @@ int main(int argc, char** argv)
     int msaa = 16;
     if(argc >= 3){msaa = atoi(argv[2]);}
 
+    // allow custom fps limit, 0 is unlimited, default is the monitor refresh rate
+    int maxfps = -1;
+    if(argc >= 4){maxfps = atoi(argv[3]);}
+
+    // allow a coarser exo on slow machines, drawn only, the simulation is the same everywhere
+    if(argc >= 6)
+    {
+        const int detail = atoi(argv[5]);
+        if(detail < EXO_LEVEL-(EXO_LODS-1) || detail > EXO_LEVEL)
+        {
+            printf("The exo detail is %u to %u.\n", EXO_LEVEL-(EXO_LODS-1), EXO_LEVEL);
+            exit(EXIT_FAILURE);
+        }
+        lod_floor = EXO_LEVEL - detail;
+    }
+
+    // make the exo
+    const uint64_t et = microtime();
+    if(exoInit(EXO_LEVEL) < 0)
+    {
+        printf("exoInit() failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Exo level %u, %lu vertices made in %.1f ms.\n", exo_level, (unsigned long)exo_numvert, (double)(microtime()-et) * 0.001);
+
     // init glfw
     if(!glfwInit()){printf("glfwInit() failed.\n"); exit(EXIT_FAILURE);}
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
@@ -1023,6 +1280,7 @@ int main(int argc, char** argv)
     }
     const GLFWvidmode* desktop = glfwGetVideoMode(glfwGetPrimaryMonitor());
     glfwSetWindowPos(window, (desktop->width/2)-(winw/2), (desktop->height/2)-(winh/2)); // center window on desktop
+    if(maxfps < 0){maxfps = desktop->refreshRate > 0 ? desktop->refreshRate : 60;}
     glfwSetWindowSizeCallback(window, window_size_callback);
     glfwSetKeyCallback(window, key_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
@@ -1068,26 +1326,63 @@ int main(int argc, char** argv)
     scaleBuffer(exo_vertices, exo_numvert*3);
     esBind(GL_ARRAY_BUFFER, &mdlInner.vid, exo_vertices, exo_vertices_size, GL_STATIC_DRAW);
     esBind(GL_ARRAY_BUFFER, &mdlInner.cid, inner_colors, inner_colors_size, GL_STATIC_DRAW);
+    inner_vertices = malloc(exo_vertices_size);
+    if(inner_vertices == NULL || ecBuild(&inner_patches[0], exo_vertices, exo_indices, exo_numind) < 0)
+    {
+        printf("ecBuild() failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(inner_vertices, exo_vertices, exo_vertices_size);
+
+    // ***** EXO LEVELS OF DETAIL *****
+    // coarser icospheres snapped onto the full mesh vertices, new index buffers over the same vertices
+    const uint64_t lt = microtime();
+    const uint fl = ldLevel(exo_numvert);
+    lod_edge[0] = ldEdge(exo_vertices, exo_indices, exo_numind);
+    cull_occluder = ldInside(exo_vertices, exo_indices, exo_numind);
+    for(uint l = 1; l < EXO_LODS; l++)
+    {
+        GLuint* ind;
+        GLsizeiptr numind;
+        if(fl < l || ldIndices(&ind, &numind, fl-l, exo_vertices, exo_numvert) < 0 || ecBuild(&inner_patches[l], exo_vertices, ind, numind) < 0)
+        {
+            printf("ldIndices() failed.\n");
+            exit(EXIT_FAILURE);
+        }
+        lod_edge[l] = ldEdge(exo_vertices, ind, numind);
+        const f32 in = ldInside(exo_vertices, ind, numind);
+        if(in < cull_occluder){cull_occluder = in;}
+        free(ind);
+    }
+    cull_occluder *= CULL_MARGIN;
+    for(GLsizeiptr i = 0; i < exo_numvert*3; i+=3)
+    {
+        const f32 r = vMod((vec){exo_vertices[i], exo_vertices[i+1], exo_vertices[i+2]});
+        if(r > exo_radius){exo_radius = r;}
+    }
 
     // ***** BIND EXO *****
-    GLsizeiptr s = exo_numvert*3;
-    for(GLsizeiptr i = 0; i < s; i+=3)
+    simExo();
+    esBind(GL_ARRAY_BUFFER, &mdlExo.vid, exo_vertices, exo_vertices_size, GL_DYNAMIC_DRAW);
+    esBind(GL_ARRAY_BUFFER, &mdlExo.cid, exo_colors, exo_colors_size, GL_DYNAMIC_DRAW);
+    for(uint l = 0; l < EXO_LODS; l++)
+    {
+        if(ecClone(&exo_patches[l], &inner_patches[l], exo_vertices) < 0 || ecUnder(&exo_patches[l], exo_vertices, inner_vertices) < 0)
+        {
+            printf("ecClone() failed.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    esBind(GL_ELEMENT_ARRAY_BUFFER, &mdlExo.iid, inner_patches[0].indices, exo_indices_size, GL_STATIC_DRAW);
+    for(uint l = 0; l < EXO_LODS; l++)
     {
-        const f32 g = (exo_colors[i] + exo_colors[i+1] + exo_colors[i+2]) / 3;
-        const f32 h = (1.f-g)*0.01f;
-        vec v = {exo_vertices[i], exo_vertices[i+1], exo_vertices[i+2]};
-        vNorm(&v);
-        vMulS(&v, v, h);
-        exo_vertices[i]   -= v.x;
-        exo_vertices[i+1] -= v.y;
-        exo_vertices[i+2] -= v.z;
-        exo_vertices[i]   *= 1.03f;
-        exo_vertices[i+1] *= 1.03f;
-        exo_vertices[i+2] *= 1.03f;
+        mdlExoLod[l] = mdlExo;
+        if(l > 0)
+            esBind(GL_ELEMENT_ARRAY_BUFFER, &mdlExoLod[l].iid, inner_patches[l].indices, inner_patches[l].numind * sizeof(GLuint), GL_STATIC_DRAW);
+        printf("Exo level %u: %zu triangles in %u patches, %.3f edge.\n", l, inner_patches[l].numind / 3, exo_patches[l].n, lod_edge[l]);
     }
-    esBind(GL_ARRAY_BUFFER, &mdlExo.vid, exo_vertices, exo_vertices_size, GL_STATIC_DRAW);
-    esBind(GL_ARRAY_BUFFER, &mdlExo.cid, exo_colors, exo_colors_size, GL_STATIC_DRAW);
-    esBind(GL_ELEMENT_ARRAY_BUFFER, &mdlExo.iid, exo_indices, exo_indices_size, GL_STATIC_DRAW);
+    printf("Planet occluder radius %.3f.\n", cull_occluder);
+    printf("Exo levels of detail made in %.1f ms.\n", (double)(microtime()-lt) * 0.001);
 
     // ***** BIND ROCK1 *****
     esBind(GL_ARRAY_BUFFER, &mdlRock[0].vid, rock1_vertices, sizeof(rock1_vertices), GL_STATIC_DRAW);
@@ -1098,12 +1393,12 @@ int main(int argc, char** argv)
     // ***** BIND ROCK2 *****
     esBind(GL_ARRAY_BUFFER, &mdlRock[1].vid, rock2_vertices, sizeof(rock2_vertices), GL_STATIC_DRAW);
     esBind(GL_ARRAY_BUFFER, &mdlRock[1].nid, rock2_normals, sizeof(rock2_normals), GL_STATIC_DRAW);
-    s = rock2_numvert*3;
+    GLsizeiptr s = rock2_numvert*3;
+    crFill(crKey(74235, 2, 0), 0, rock2_colors, s);
     for(GLsizeiptr i = 0; i < s; i+=3)
     {
-        rock2_colors[i] = randf();
         if(rock2_colors[i] > 0.5f)
-            rock2_colors[i+1] = randf()*0.5f;
+            rock2_colors[i+1] *= 0.5f;
         else
             rock2_colors[i+1] = 0.f;
         rock2_colors[i+2] = 0.f;
@@ -1115,11 +1410,11 @@ int main(int argc, char** argv)
     esBind(GL_ARRAY_BUFFER, &mdlRock[2].vid, rock3_vertices, sizeof(rock3_vertices), GL_STATIC_DRAW);
     esBind(GL_ARRAY_BUFFER, &mdlRock[2].nid, rock3_normals, sizeof(rock3_normals), GL_STATIC_DRAW);
     s = rock3_numvert*3;
+    crFill(crKey(74235, 3, 0), 0, rock3_colors, s);
     for(GLsizeiptr i = 0; i < s; i+=3)
     {
         rock3_colors[i] = 0.f;
-        rock3_colors[i+1] = randf();
-        rock3_colors[i+2] = rock3_colors[i+1]+(randf()*(1.f-rock3_colors[i+1]));
+        rock3_colors[i+2] = rock3_colors[i+1]+(rock3_colors[i+2]*(1.f-rock3_colors[i+1]));
     }
     esBind(GL_ARRAY_BUFFER, &mdlRock[2].cid, rock3_colors, sizeof(rock3_colors), GL_STATIC_DRAW);
     esBind(GL_ARRAY_BUFFER, &mdlRock[2].iid, rock3_indices, sizeof(rock3_indices), GL_STATIC_DRAW);
@@ -1160,6 +1455,32 @@ int main(int argc, char** argv)
     //esBind(GL_ARRAY_BUFFER, &mdlRock[8].cid, rock9_colors, sizeof(rock9_colors), GL_STATIC_DRAW);
     esBind(GL_ARRAY_BUFFER, &mdlRock[8].iid, rock9_indices, sizeof(rock9_indices), GL_STATIC_DRAW);
 
+    // ***** BOUNDS *****
+    const GLfloat* rock_vertices[9] = {rock1_vertices, rock2_vertices, rock3_vertices, rock4_vertices, rock5_vertices, rock6_vertices, rock7_vertices, rock8_vertices, rock9_vertices};
+    const GLsizeiptr rock_numvert[9] = {rock1_numvert, rock2_numvert, rock3_numvert, rock4_numvert, rock5_numvert, rock6_numvert, rock7_numvert, rock8_numvert, rock9_numvert};
+    for(uint i = 0; i < 9; i++)
+    {
+        const f32 r = modelRadius(rock_vertices[i], rock_numvert[i]);
+        if(r > rock_radius){rock_radius = r;}
+    }
+
+    // ***** COLOUR COMBINATIONS *****
+    mdlInner.iid = mdlExo.iid;
+    for(uint l = 0; l < EXO_LODS; l++)
+    {
+        mdlInnerLod[l] = mdlInner;
+        mdlInnerLod[l].iid = mdlExoLod[l].iid;
+    }
+    for(uint i = 0; i < 9; i++)
+    {
+        mdlComet[0][i] = mdlRock[i];
+        mdlComet[0][i].cid = mdlRock[0].cid;
+        mdlComet[1][i] = mdlRock[i];
+        mdlComet[1][i].cid = mdlRock[1].cid;
+    }
+    mdlPlayer = mdlRock[8];
+    mdlPlayer.cid = mdlRock[2].cid;
+
 //*************************************
 // compile & link shader programs
 //*************************************
@@ -1167,6 +1488,16 @@ int main(int argc, char** argv)
     makeLambert();
     makeLambert2();
     makeLambert3();
+    makeLambert2C();
+
+    // one draw per rock model when the driver can instance
+    if(GLAD_GL_VERSION_3_3)
+    {
+        makeLambert3I();
+        glGenBuffers(1, &inst_buf);
+        instanced = 1;
+        printf("Instanced comets (GL 3.3).\n");
+    }
 
 //*************************************
 // configure render options
@@ -1199,6 +1530,11 @@ int main(int argc, char** argv)
     glDrawElements(GL_TRIANGLES, ncube_numind, GL_UNSIGNED_INT, 0);
     glfwSwapBuffers(window);
 
+    // from here on vertex state goes through glstate.h
+    gsInit();
+    if(gs_vaos == 1)
+        printf("Vertex array objects (GL 3.0).\n");
+
     // create network thread
     pthread_t tid;
     if(pthread_create(&tid, NULL, netThread, NULL) != 0)
@@ -1229,27 +1565,39 @@ int main(int argc, char** argv)
     glfwSetWindowTitle(window, "Online Fractal Attack Lite");
     window_size_callback(window, winw, winh);
 
-    // seed random
-    srandf(sepoch);
+    // seed the simulation, tick 0 is the epoch
+    if(simInit(sepoch) < 0)
+    {
+        printf("simInit() failed.\n");
+        exit(EXIT_FAILURE);
+    }
 
-    // set comets
-    randComets();
+    // record the game, ./fa-sim -r replays it
+    if(argc >= 5 && strcmp(argv[4], "-") != 0)
+    {
+        if(rpCreate(&rec, argv[4], sepoch) < 0)
+            printf("could not create the game log %s\n", argv[4]);
+        else
+            printf("recording to %s\n", argv[4]);
+    }
 
     // init
     t = glfwGetTime();
     lfct = t;
     
-    // fps accurate event loop
-    const double maxfps = 60.0;
-    useconds_t wait_interval = 1000000 / maxfps;
+    // fps accurate event loop, the simulation runs at SIM_HZ regardless
+    useconds_t wait_interval = maxfps > 0 ? 1000000 / maxfps : 0;
     useconds_t wait = wait_interval;
     while(!glfwWindowShouldClose(window))
     {
-        usleep(wait);
+        const uint64_t frame_span = trBegin();
+        if(wait > 0){usleep(wait);}
+        ftMark(FT_SLEEP);
         t = glfwGetTime();
         
         // tick internal state
         glfwPollEvents();
+        ftMark(FT_INPUT);
         main_loop();
 
         // accurate fps
@@ -1258,9 +1606,16 @@ int main(int argc, char** argv)
             wait = wait_interval;
         
         fc++;
+        ftFrame();
+        gsFrame();
+        trEnd("frame", frame_span);
     }
 
     // done
+    trStop();
+    ftDump();
+    gsDump();
+    rpClose(&rec);
     glfwDestroyWindow(window);
     glfwTerminate();
     exit(EXIT_SUCCESS);